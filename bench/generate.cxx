@@ -0,0 +1,342 @@
+// Writes synthetic nuselection/EventSelectionFilter ntuples with the branches
+// Processor::run, the selection presets, the systematics and the event display
+// read, plus a Hub configuration describing them. The strangeness sample also
+// gets a cv detector variation.
+//
+//   rarexsec_bench_generate <out_dir> [events=20000] [files=2] [image=64] [seed=12345]
+
+#include <TDirectory.h>
+#include <TFile.h>
+#include <TMath.h>
+#include <TRandom3.h>
+#include <TTree.h>
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Settings {
+    std::string out_dir;
+    long long events = 20000;
+    int files = 2;
+    int image = 64;
+    unsigned seed = 12345;
+};
+
+struct Sample {
+    std::string kind;
+    std::string stem;
+    bool mc = true;
+    double strange_rate = 0.02;
+    double pot = 0.0;
+    double pot_eqv = 0.0;
+    double trig = 0.0;
+    double trig_eqv = 0.0;
+};
+
+constexpr int n_ppfx = 600;
+constexpr int n_genie = 500;
+constexpr int n_reint = 100;
+constexpr int n_labels = 15;
+
+struct Event {
+    int run = 0, sub = 0, evt = 0;
+
+    float optical_filter_pe_beam = 0.f, optical_filter_pe_veto = 0.f;
+    int software_trigger = 0;
+    int num_slices = 0;
+    float topological_score = 0.f;
+    float contained_fraction = 0.f, slice_cluster_fraction = 0.f;
+    float reco_x = 0.f, reco_y = 0.f, reco_z = 0.f;
+    std::vector<float> track_shower_scores, trk_llr_pid_v, track_length, track_distance_to_vertex;
+    std::vector<unsigned> pfp_generations;
+
+    float weightSpline = 1.f, weightTune = 1.f, weightSplineTimesTune = 1.f, ppfx_cv = 1.f;
+    float nu_x = 0.f, nu_y = 0.f, nu_z = 0.f;
+    int neutrino_pdg = 0, interaction_ccnc = 0, interaction_mode = 0;
+    int count_kaon_plus = 0, count_kaon_minus = 0, count_kaon_zero = 0, count_lambda = 0;
+    int count_sigma_plus = 0, count_sigma_zero = 0, count_sigma_minus = 0;
+    int count_proton = 0, count_pi_minus = 0, count_pi_plus = 0, count_pi_zero = 0, count_gamma = 0;
+    float purity = 0.f, completeness = 0.f;
+    std::vector<unsigned short> weightsPPFX, weightsGenie, weightsReint;
+
+    std::vector<float> det_u, det_v, det_w;
+    std::vector<int> sem_u, sem_v, sem_w;
+};
+
+//____________________________________________________________________________
+Settings parse(int argc, char** argv)
+{
+    if (argc < 2)
+        throw std::invalid_argument("usage: rarexsec_bench_generate <out_dir> [events] [files] [image] [seed]");
+    Settings s;
+    s.out_dir = argv[1];
+    if (argc > 2)
+        s.events = std::atoll(argv[2]);
+    if (argc > 3)
+        s.files = std::atoi(argv[3]);
+    if (argc > 4)
+        s.image = std::atoi(argv[4]);
+    if (argc > 5)
+        s.seed = static_cast<unsigned>(std::strtoul(argv[5], nullptr, 10));
+    if (s.events <= 0 || s.files <= 0 || s.image <= 0)
+        throw std::invalid_argument("events, files and image must be positive");
+    return s;
+}
+//____________________________________________________________________________
+void fill_universes(TRandom3& rng, std::vector<unsigned short>& out, int n, double width)
+{
+    out.resize(static_cast<std::size_t>(n));
+    for (auto& w : out)
+        w = static_cast<unsigned short>(std::clamp(rng.Gaus(1000.0, 1000.0 * width), 0.0, 65535.0));
+}
+//____________________________________________________________________________
+void fill_images(TRandom3& rng, int size, Event& ev)
+{
+    const std::size_t n = static_cast<std::size_t>(size) * size;
+    for (auto* plane : {&ev.det_u, &ev.det_v, &ev.det_w})
+        plane->assign(n, 0.f);
+    for (auto* plane : {&ev.sem_u, &ev.sem_v, &ev.sem_w})
+        plane->assign(n, 0);
+    const int tracks = 1 + rng.Poisson(2.0);
+    for (int p = 0; p < 3; ++p) {
+        auto& det = p == 0 ? ev.det_u : (p == 1 ? ev.det_v : ev.det_w);
+        auto& sem = p == 0 ? ev.sem_u : (p == 1 ? ev.sem_v : ev.sem_w);
+        const double x0 = rng.Uniform(0.2, 0.8) * size;
+        const double y0 = rng.Uniform(0.2, 0.8) * size;
+        for (int t = 0; t < tracks; ++t) {
+            const double phi = rng.Uniform(0.0, 2.0 * TMath::Pi());
+            const double len = rng.Exp(0.3 * size);
+            const int label = 2 + static_cast<int>(rng.Integer(n_labels - 2));
+            for (double l = 0.0; l < len; l += 0.5) {
+                const int c = static_cast<int>(x0 + l * std::cos(phi));
+                const int r = static_cast<int>(y0 + l * std::sin(phi));
+                if (c < 0 || r < 0 || c >= size || r >= size)
+                    break;
+                const std::size_t idx = static_cast<std::size_t>(r) * size + c;
+                det[idx] += static_cast<float>(rng.Landau(40.0, 8.0));
+                sem[idx] = label;
+            }
+        }
+        for (std::size_t i = 0; i < n; ++i) {
+            if (rng.Rndm() < 0.01) {
+                det[i] += static_cast<float>(rng.Exp(6.0));
+                if (sem[i] == 0)
+                    sem[i] = 1;
+            }
+        }
+    }
+}
+//____________________________________________________________________________
+void fill_event(TRandom3& rng, const Sample& sample, int image, Event& ev)
+{
+    ev.optical_filter_pe_beam = static_cast<float>(rng.Exp(150.0));
+    ev.optical_filter_pe_veto = static_cast<float>(rng.Exp(8.0));
+    ev.software_trigger = rng.Rndm() < 0.85 ? 1 : 0;
+    const double u = rng.Rndm();
+    ev.num_slices = u < 0.75 ? 1 : (u < 0.9 ? 0 : 2);
+    ev.topological_score = static_cast<float>(rng.Rndm());
+    ev.contained_fraction = static_cast<float>(rng.Rndm());
+    ev.slice_cluster_fraction = static_cast<float>(rng.Uniform(0.2, 1.0));
+    ev.reco_x = static_cast<float>(rng.Uniform(-10.0, 266.0));
+    ev.reco_y = static_cast<float>(rng.Uniform(-125.0, 125.0));
+    ev.reco_z = static_cast<float>(rng.Uniform(-10.0, 1046.0));
+
+    const int npfp = rng.Poisson(3.0);
+    ev.track_shower_scores.resize(npfp);
+    ev.trk_llr_pid_v.resize(npfp);
+    ev.track_length.resize(npfp);
+    ev.track_distance_to_vertex.resize(npfp);
+    ev.pfp_generations.resize(npfp);
+    for (int i = 0; i < npfp; ++i) {
+        ev.track_shower_scores[i] = static_cast<float>(rng.Rndm());
+        ev.trk_llr_pid_v[i] = static_cast<float>(rng.Gaus(0.1, 0.5));
+        ev.track_length[i] = static_cast<float>(rng.Exp(40.0));
+        ev.track_distance_to_vertex[i] = static_cast<float>(rng.Exp(3.0));
+        ev.pfp_generations[i] = rng.Rndm() < 0.8 ? 2u : 3u;
+    }
+
+    if (sample.mc) {
+        ev.weightSpline = static_cast<float>(std::max(0.0, rng.Gaus(1.0, 0.05)));
+        ev.weightTune = static_cast<float>(std::max(0.0, rng.Gaus(1.0, 0.1)));
+        ev.weightSplineTimesTune = ev.weightSpline * ev.weightTune;
+        ev.ppfx_cv = static_cast<float>(std::max(0.0, rng.Gaus(1.0, 0.05)));
+        ev.nu_x = static_cast<float>(rng.Uniform(-50.0, 306.0));
+        ev.nu_y = static_cast<float>(rng.Uniform(-160.0, 160.0));
+        ev.nu_z = static_cast<float>(rng.Uniform(-100.0, 1136.0));
+        const double f = rng.Rndm();
+        ev.neutrino_pdg = f < 0.9 ? 14 : (f < 0.95 ? -14 : 12);
+        ev.interaction_ccnc = rng.Rndm() < 0.75 ? 0 : 1;
+        static constexpr int modes[] = {0, 1, 2, 3, 10};
+        ev.interaction_mode = modes[rng.Integer(5)];
+        const bool strange = rng.Rndm() < sample.strange_rate;
+        ev.count_kaon_plus = strange ? 1 + rng.Poisson(0.2) : 0;
+        ev.count_kaon_minus = strange ? rng.Poisson(0.1) : 0;
+        ev.count_kaon_zero = strange ? rng.Poisson(0.4) : 0;
+        ev.count_lambda = strange ? rng.Poisson(0.5) : 0;
+        ev.count_sigma_plus = strange ? rng.Poisson(0.1) : 0;
+        ev.count_sigma_zero = strange ? rng.Poisson(0.1) : 0;
+        ev.count_sigma_minus = strange ? rng.Poisson(0.05) : 0;
+        ev.count_proton = rng.Poisson(1.2);
+        ev.count_pi_minus = rng.Poisson(0.3);
+        ev.count_pi_plus = rng.Poisson(0.3);
+        ev.count_pi_zero = rng.Poisson(0.2);
+        ev.count_gamma = rng.Poisson(0.3);
+        ev.purity = static_cast<float>(rng.Rndm());
+        ev.completeness = static_cast<float>(rng.Rndm());
+        fill_universes(rng, ev.weightsPPFX, n_ppfx, 0.08);
+        fill_universes(rng, ev.weightsGenie, n_genie, 0.15);
+        fill_universes(rng, ev.weightsReint, n_reint, 0.03);
+    }
+    fill_images(rng, image, ev);
+}
+//____________________________________________________________________________
+void book(TTree& t, Event& ev, bool mc)
+{
+    t.Branch("run", &ev.run);
+    t.Branch("sub", &ev.sub);
+    t.Branch("evt", &ev.evt);
+    t.Branch("optical_filter_pe_beam", &ev.optical_filter_pe_beam);
+    t.Branch("optical_filter_pe_veto", &ev.optical_filter_pe_veto);
+    t.Branch("software_trigger", &ev.software_trigger);
+    t.Branch("num_slices", &ev.num_slices);
+    t.Branch("topological_score", &ev.topological_score);
+    t.Branch("contained_fraction", &ev.contained_fraction);
+    t.Branch("slice_cluster_fraction", &ev.slice_cluster_fraction);
+    t.Branch("reco_neutrino_vertex_sce_x", &ev.reco_x);
+    t.Branch("reco_neutrino_vertex_sce_y", &ev.reco_y);
+    t.Branch("reco_neutrino_vertex_sce_z", &ev.reco_z);
+    t.Branch("track_shower_scores", &ev.track_shower_scores);
+    t.Branch("trk_llr_pid_v", &ev.trk_llr_pid_v);
+    t.Branch("track_length", &ev.track_length);
+    t.Branch("track_distance_to_vertex", &ev.track_distance_to_vertex);
+    t.Branch("pfp_generations", &ev.pfp_generations);
+    t.Branch("event_detector_image_u", &ev.det_u);
+    t.Branch("event_detector_image_v", &ev.det_v);
+    t.Branch("event_detector_image_w", &ev.det_w);
+    t.Branch("semantic_image_u", &ev.sem_u);
+    t.Branch("semantic_image_v", &ev.sem_v);
+    t.Branch("semantic_image_w", &ev.sem_w);
+    if (!mc)
+        return;
+    t.Branch("weightSpline", &ev.weightSpline);
+    t.Branch("weightTune", &ev.weightTune);
+    t.Branch("weightSplineTimesTune", &ev.weightSplineTimesTune);
+    t.Branch("ppfx_cv", &ev.ppfx_cv);
+    t.Branch("neutrino_vertex_x", &ev.nu_x);
+    t.Branch("neutrino_vertex_y", &ev.nu_y);
+    t.Branch("neutrino_vertex_z", &ev.nu_z);
+    t.Branch("neutrino_pdg", &ev.neutrino_pdg);
+    t.Branch("interaction_ccnc", &ev.interaction_ccnc);
+    t.Branch("interaction_mode", &ev.interaction_mode);
+    t.Branch("count_kaon_plus", &ev.count_kaon_plus);
+    t.Branch("count_kaon_minus", &ev.count_kaon_minus);
+    t.Branch("count_kaon_zero", &ev.count_kaon_zero);
+    t.Branch("count_lambda", &ev.count_lambda);
+    t.Branch("count_sigma_plus", &ev.count_sigma_plus);
+    t.Branch("count_sigma_zero", &ev.count_sigma_zero);
+    t.Branch("count_sigma_minus", &ev.count_sigma_minus);
+    t.Branch("count_proton", &ev.count_proton);
+    t.Branch("count_pi_minus", &ev.count_pi_minus);
+    t.Branch("count_pi_plus", &ev.count_pi_plus);
+    t.Branch("count_pi_zero", &ev.count_pi_zero);
+    t.Branch("count_gamma", &ev.count_gamma);
+    t.Branch("neutrino_purity_from_pfp", &ev.purity);
+    t.Branch("neutrino_completeness_from_pfp", &ev.completeness);
+    t.Branch("weightsPPFX", &ev.weightsPPFX);
+    t.Branch("weightsGenie", &ev.weightsGenie);
+    t.Branch("weightsReint", &ev.weightsReint);
+}
+//____________________________________________________________________________
+std::vector<std::string> write_sample(const Settings& s, const Sample& sample, unsigned seed, int run)
+{
+    std::vector<std::string> paths;
+    TRandom3 rng(seed);
+    Event ev;
+    ev.run = run;
+    long long written = 0;
+    for (int f = 0; f < s.files; ++f) {
+        const long long n = s.events * (f + 1) / s.files - written;
+        const auto path = (std::filesystem::path(s.out_dir) / (sample.stem + "_" + std::to_string(f) + ".root")).string();
+        std::unique_ptr<TFile> file{TFile::Open(path.c_str(), "RECREATE")};
+        if (!file || file->IsZombie())
+            throw std::runtime_error("cannot write " + path);
+        TDirectory* dir = file->mkdir("nuselection");
+        dir->cd();
+        TTree tree("EventSelectionFilter", "synthetic rarexsec benchmark events");
+        book(tree, ev, sample.mc);
+        for (long long i = 0; i < n; ++i) {
+            ev.sub = static_cast<int>((written + i) / 100);
+            ev.evt = static_cast<int>(written + i);
+            fill_event(rng, sample, s.image, ev);
+            tree.Fill();
+        }
+        tree.Write();
+        written += n;
+        paths.push_back(path);
+    }
+    return paths;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    try {
+        const auto s = parse(argc, argv);
+        std::filesystem::create_directories(s.out_dir);
+
+        const double pot = 1e20;
+        const std::vector<Sample> samples{
+            {"beam", "beam", true, 0.02, pot, 10 * pot, 0.0, 0.0},
+            {"strangeness", "strangeness", true, 1.0, pot, 100 * pot, 0.0, 0.0},
+            {"ext", "ext", false, 0.0, 0.0, 0.0, 1e6, 2e6},
+            {"data", "data", false, 0.0, 0.0, 0.0, 0.0, 0.0},
+        };
+
+        nlohmann::json entries = nlohmann::json::array();
+        int run = 5000;
+        for (std::size_t i = 0; i < samples.size(); ++i) {
+            const auto& sample = samples[i];
+            auto files = write_sample(s, sample, s.seed + 17 * static_cast<unsigned>(i), run++);
+            nlohmann::json j{{"kind", sample.kind}, {"files", files}};
+            if (sample.kind == "beam" || sample.kind == "strangeness") {
+                j["pot"] = sample.pot;
+                j["pot_eff"] = sample.pot_eqv;
+            } else if (sample.kind == "ext") {
+                j["trig"] = sample.trig;
+                j["trig_eff"] = sample.trig_eqv;
+            }
+            if (sample.kind == "strangeness") {
+                Sample cv = sample;
+                cv.stem = "strangeness_detvar_cv";
+                j["detvars"] = {{"cv", {{"files", write_sample(s, cv, s.seed + 1000, run++)}}}};
+            }
+            entries.push_back(j);
+        }
+
+        const nlohmann::json cfg{{"beamlines", {{"bench", {{"run1", {{"nominal_pot", pot}, {"samples", entries}}}}}}}};
+        const auto cfg_path = (std::filesystem::path(s.out_dir) / "samples.json").string();
+        std::ofstream out(cfg_path);
+        if (!out)
+            throw std::runtime_error("cannot write " + cfg_path);
+        out << cfg.dump(2) << "\n";
+        std::cout << "wrote " << cfg_path << " (" << s.events << " events per sample)" << std::endl;
+    } catch (const std::exception& ex) {
+        std::cerr << "rarexsec_bench_generate: " << ex.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,229 @@
+// Times the main workflows on the synthetic samples written by rarexsec_bench_generate
+// and writes the timings as JSON.
+//
+//   rarexsec_bench_run <samples.json> [out_dir=bench_out] [threads=0]
+//
+// threads=0 leaves implicit multi-threading off; a negative value uses all cores.
+// Set RAREXSEC_BENCH_STAGES to a comma-separated subset of
+// hub,stacked,cutflow,systpack,snapshot,fit to run only those stages.
+
+#include <ROOT/RDataFrame.hxx>
+#include <TFile.h>
+#include <TH1D.h>
+#include <TROOT.h>
+#include <TStopwatch.h>
+#include <nlohmann/json.hpp>
+
+#include "rarexsec/Hub.h"
+#include "rarexsec/fit/Fitter.h"
+#include "rarexsec/plot/StackedHist.h"
+#include "rarexsec/proc/Memory.h"
+#include "rarexsec/proc/Progress.h"
+#include "rarexsec/proc/Selection.h"
+#include "rarexsec/proc/Snapshot.h"
+#include "rarexsec/syst/SystematicsPack.h"
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Entries = std::vector<const rarexsec::Entry*>;
+
+const std::string input_tree = "nuselection/EventSelectionFilter";
+
+//____________________________________________________________________________
+std::set<std::string> wanted_stages()
+{
+    std::set<std::string> out;
+    const char* env = std::getenv("RAREXSEC_BENCH_STAGES");
+    std::stringstream ss(env ? env : "");
+    for (std::string tok; std::getline(ss, tok, ',');)
+        if (!tok.empty())
+            out.insert(tok);
+    return out;
+}
+//____________________________________________________________________________
+// Entries read by a full pass over the samples, taken from the tree headers so
+// that no untimed event loop runs before the stages.
+unsigned long long count_events(const Entries& entries)
+{
+    unsigned long long n = 0;
+    for (const auto* e : entries) {
+        const auto& f = e->nominal;
+        const long long headers = f.skim_tree.empty() ? rarexsec::progress::entries(input_tree, f.files)
+                                                      : rarexsec::progress::entries(f.skim_tree, f.files);
+        n += headers >= 0 ? static_cast<unsigned long long>(headers) : f.df->Count().GetValue();
+    }
+    return n;
+}
+//____________________________________________________________________________
+bool is_signal(int ch)
+{
+    const auto c = static_cast<rarexsec::Channel>(ch);
+    return c == rarexsec::Channel::CCS1 || c == rarexsec::Channel::CCSgt1;
+}
+//____________________________________________________________________________
+std::unique_ptr<TH1D> total(const Entries& entries, const TH1D& model, const std::string& name,
+                            const std::function<ROOT::RDF::RNode(ROOT::RDF::RNode)>& select)
+{
+    std::vector<ROOT::RDF::RResultPtr<TH1D>> parts;
+    for (const auto* e : entries) {
+        auto node = rarexsec::selection::apply(e->rnode(), rarexsec::selection::Preset::InclusiveMuCC, *e);
+        parts.push_back(select(node).Histo1D(ROOT::RDF::TH1DModel(model), "topological_score", "w_nominal"));
+    }
+    std::unique_ptr<TH1D> out(static_cast<TH1D*>(model.Clone(name.c_str())));
+    out->SetDirectory(nullptr);
+    for (auto& p : parts)
+        out->Add(p.GetPtr());
+    return out;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        std::cerr << "usage: rarexsec_bench_run <samples.json> [out_dir] [threads]" << std::endl;
+        return 1;
+    }
+    const std::string cfg = argv[1];
+    const std::string out_dir = argc > 2 ? argv[2] : "bench_out";
+    const int threads = argc > 3 ? std::atoi(argv[3]) : 0;
+
+    gROOT->SetBatch(true);
+    if (threads < 0)
+        ROOT::EnableImplicitMT();
+    else if (threads > 0)
+        ROOT::EnableImplicitMT(static_cast<unsigned>(threads));
+    std::filesystem::create_directories(out_dir);
+
+    const auto stages = wanted_stages();
+    nlohmann::json report{{"config", cfg}, {"threads", threads}, {"stages", nlohmann::json::array()}};
+    auto run = [&](const std::string& name, unsigned long long events, const std::function<void()>& body) {
+        if (!stages.empty() && !stages.count(name))
+            return;
+        nlohmann::json stage{{"stage", name}};
+        TFile::SetFileBytesRead(0);
+        TStopwatch sw;
+        try {
+            rarexsec::memory::Stage mem("bench:" + name);
+            body();
+            sw.Stop();
+            stage["status"] = "ok";
+        } catch (const std::exception& ex) {
+            sw.Stop();
+            stage["status"] = "error";
+            stage["error"] = ex.what();
+        }
+        stage["real_s"] = sw.RealTime();
+        stage["cpu_s"] = sw.CpuTime();
+        stage["bytes_read"] = TFile::GetFileBytesRead();
+        const auto [rss, rss_peak] = rarexsec::memory::rss();
+        stage["rss"] = rss;
+        stage["rss_peak"] = rss_peak;
+        if (events > 0) {
+            stage["events"] = events;
+            stage["events_per_s"] = sw.RealTime() > 0.0 ? events / sw.RealTime() : 0.0;
+        }
+        std::cout << stage.dump() << std::endl;
+        report["stages"].push_back(stage);
+    };
+
+    std::optional<rarexsec::Hub> hub;
+    run("hub", 0, [&] { hub.emplace(cfg); });
+    if (!hub) {
+        std::cerr << "rarexsec_bench_run: cannot build the hub from " << cfg << std::endl;
+        return 1;
+    }
+
+    const std::vector<std::string> periods{"run1"};
+    const auto mc = hub->simulation_entries("bench", periods);
+    Entries mc_only, ext;
+    for (const auto* e : mc)
+        (e->source == rarexsec::Source::MC ? mc_only : ext).push_back(e);
+    const auto data = hub->data_entries("bench", periods);
+    const auto n_mc = count_events(mc);
+    const auto n_all = n_mc + count_events(data);
+
+    run("stacked", n_all, [&] {
+        rarexsec::plot::Options opt;
+        opt.out_dir = out_dir + "/plots";
+        opt.show_ratio = true;
+        opt.beamline = "bench";
+        opt.periods = periods;
+        for (const char* var : {"topological_score", "contained_fraction", "num_slices"}) {
+            rarexsec::plot::TH1DModel spec;
+            spec.id = var;
+            spec.nbins = 20;
+            spec.xmin = 0.0;
+            spec.xmax = std::string(var) == "num_slices" ? 4.0 : 1.0;
+            spec.sel = rarexsec::selection::Preset::Slice;
+            rarexsec::plot::StackedHist(spec, opt, mc, data).draw_and_save("png");
+        }
+    });
+
+    run("cutflow", n_mc, [&] {
+        const auto r = rarexsec::selection::evaluate(mc_only, is_signal, rarexsec::selection::Preset::InclusiveMuCC);
+        if (!(r.selected >= 0.0))
+            throw std::runtime_error("cutflow returned no selection");
+    });
+
+    run("systpack", n_mc, [&] {
+        rarexsec::systpack::Config c;
+        c.value_col = "topological_score";
+        c.N_ppfx = 100;
+        c.N_genie = 100;
+        c.N_reint = 20;
+        const TH1D model("bench_systpack", "", 20, 0.0, 1.0);
+        rarexsec::systpack::SystematicsPack(c).build(model, mc_only, ext);
+    });
+
+    run("snapshot", n_all, [&] {
+        rarexsec::snapshot::Options opt;
+        opt.outdir = out_dir + "/snapshots";
+        opt.outfile = "bench.root";
+        opt.preset = rarexsec::selection::Preset::Slice;
+        auto samples = mc;
+        samples.insert(samples.end(), data.begin(), data.end());
+        rarexsec::snapshot::write(samples, opt);
+    });
+
+    run("fit", n_all, [&] {
+        const TH1D model("bench_fit", "", 10, 0.0, 1.0);
+        auto h_data = total(data, model, "bench_data", [](ROOT::RDF::RNode n) { return n; });
+        auto h_sig = total(mc_only, model, "bench_sig", [](ROOT::RDF::RNode n) {
+            return n.Filter([](int ch) { return is_signal(ch); }, {"analysis_channels"});
+        });
+        auto h_bkg = total(mc, model, "bench_bkg", [](ROOT::RDF::RNode n) {
+            return n.Filter([](int ch) { return !is_signal(ch); }, {"analysis_channels"});
+        });
+        rarexsec::internal::fit::Fitter fitter;
+        fitter.add_channel("sr", h_data.get());
+        fitter.add_process("sr", "signal", h_sig.get(), true);
+        fitter.add_process("sr", "background", h_bkg.get());
+        fitter.add_norm_systematic("bkg_norm");
+        fitter.set_norm_effect("bkg_norm", "sr", "background", 0.1);
+        fitter.set_mc_stat(true);
+        const auto r = fitter.fit();
+        fitter.impacts();
+        if (r.status != 0)
+            throw std::runtime_error("fit status " + std::to_string(r.status));
+    });
+
+    const auto path = (std::filesystem::path(out_dir) / "bench_results.json").string();
+    std::ofstream out(path);
+    out << report.dump(2) << "\n";
+    std::cout << "wrote " << path << std::endl;
+    return 0;
+}
@@ -1,10 +1,25 @@
 #include "rarexsec/Hub.h"
 #include "rarexsec/Processor.h"
+#include "rarexsec/proc/ColumnTrace.h"
+#include "rarexsec/proc/EventIndex.h"
+#include "rarexsec/proc/Memory.h"
+#include "rarexsec/proc/Profile.h"
+#include "rarexsec/proc/Progress.h"
+#include "rarexsec/proc/Snapshot.h"
 #include "rarexsec/proc/Volume.h"
 
+#include <ROOT/RNTupleDS.hxx>
+#include <RVersion.h>
+#include <TFile.h>
+#include <TKey.h>
+#include <TNamed.h>
+
 #include <algorithm>
 #include <cctype>
+#include <filesystem>
 #include <fstream>
+#include <iostream>
+#include <memory>
 #include <nlohmann/json.hpp>
 #include <sstream>
 #include <stdexcept>
@@ -15,6 +30,8 @@
 
 using json = nlohmann::json;
 
+static const std::string input_tree = "nuselection/EventSelectionFilter";
+
 //____________________________________________________________________________
 static std::string to_lower(std::string s)
 {
@@ -52,26 +69,245 @@ parse_kind_slice(const std::string& kind, const json& s)
     throw std::runtime_error("unknown kind: " + kind);
 }
 //____________________________________________________________________________
-rarexsec::Frame rarexsec::Hub::sample(const Entry& rec) const
+static std::unordered_map<std::string, std::string> list_keys(const std::string& path)
+{
+    std::unique_ptr<TFile> f{TFile::Open(path.c_str(), "READ")};
+    if (!f || f->IsZombie())
+        throw std::runtime_error("cannot open skim file " + path);
+    std::unordered_map<std::string, std::string> out;
+    for (auto* obj : *f->GetListOfKeys()) {
+        auto* key = static_cast<TKey*>(obj);
+        out.emplace(key->GetName(), key->GetClassName());
+    }
+    return out;
+}
+//____________________________________________________________________________
+static std::unordered_map<std::string, double> provenance_scales(const json& prov)
+{
+    if (!prov.is_object() || !prov.contains("scales"))
+        return {};
+    return prov.at("scales").get<std::unordered_map<std::string, double>>();
+}
+//____________________________________________________________________________
+static json read_provenance(const std::string& path, const std::string& tree)
 {
-    static const std::string tree = "nuselection/EventSelectionFilter";
-    auto df_ptr = std::make_shared<ROOT::RDataFrame>(tree, rec.files);
-    ROOT::RDF::RNode node = *df_ptr;
+    std::unique_ptr<TFile> f{TFile::Open(path.c_str(), "READ")};
+    if (!f || f->IsZombie())
+        return json::object();
+    std::unique_ptr<TNamed> meta{f->Get<TNamed>(rarexsec::snapshot::provenance_name(tree).c_str())};
+    if (!meta)
+        return json::object();
+    return json::parse(meta->GetTitle(), nullptr, false);
+}
+//____________________________________________________________________________
+// A skim replaces its source frame, so every column the analysis reads from it
+// has to be in the skim. Columns the source never had are recorded by the
+// writer as unavailable and are not reported.
+static void check_skim_columns(const std::string& tree, const json& prov,
+                               const std::vector<std::string>& required, bool strict)
+{
+    if (!prov.is_object() || !prov.contains("columns"))
+        return;
+    const auto have = prov.at("columns").get<std::vector<std::string>>();
+    const auto absent = prov.value("unavailable", std::vector<std::string>{});
+    std::string missing;
+    for (const auto& c : required) {
+        if (std::find(have.begin(), have.end(), c) != have.end() ||
+            std::find(absent.begin(), absent.end(), c) != absent.end())
+            continue;
+        missing += (missing.empty() ? "" : ", ") + c;
+    }
+    if (missing.empty())
+        return;
+    const std::string msg = "skim tree " + tree + " lacks column(s) " + missing;
+    if (strict)
+        throw std::runtime_error(msg);
+    std::cerr << "[Hub] " << msg << "; rebuild the skim to read them" << '\n';
+}
+//____________________________________________________________________________
+static std::shared_ptr<ROOT::RDataFrame> make_rntuple_frame(const std::string& name, const std::string& file)
+{
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6, 30, 0)
+    return std::make_shared<ROOT::RDataFrame>(ROOT::RDF::Experimental::FromRNTuple(name, file));
+#else
+    return std::make_shared<ROOT::RDataFrame>(ROOT::Experimental::MakeNTupleDataFrame(name, file));
+#endif
+}
+//____________________________________________________________________________
+rarexsec::Frame rarexsec::Hub::sample(const Entry& rec)
+{
+    memory::Growth growth(memory::graphs);
+    if (rec.skimmed()) {
+        auto df_ptr = rec.skim_rntuple ? make_rntuple_frame(rec.skim_tree, rec.skim_files.front())
+                                       : std::make_shared<ROOT::RDataFrame>(rec.skim_tree, rec.skim_files);
+        auto counter = progress::Monitor::instance().counter(profile::label(rec), rec.skim_rntuple ? "" : rec.skim_tree,
+                                                             rec.skim_files, df_ptr->GetNSlots());
+        ROOT::RDF::RNode node = progress::Monitor::instance().attach(*df_ptr, counter);
+        if (trace::dry_run())
+            node = node.Filter([] { return false; }, {}, "trace_dry_run");
+        node = profile::attach(node, profile::label(rec));
+        Frame frame{df_ptr, std::move(node)};
+        frame.files = rec.skim_files;
+        frame.skim_tree = rec.skim_tree;
+        frame.skim_rntuple = rec.skim_rntuple;
+        frame.scales = rec.skim_scales;
+        frame.progress = std::move(counter);
+        return frame;
+    }
+
+    auto df_ptr = std::make_shared<ROOT::RDataFrame>(input_tree, rec.files);
+    auto counter = progress::Monitor::instance().counter(profile::label(rec), input_tree, rec.files, df_ptr->GetNSlots());
+    ROOT::RDF::RNode node = progress::Monitor::instance().attach(*df_ptr, counter);
 
+    if (trace::dry_run())
+        node = node.Filter([] { return false; }, {}, "trace_dry_run");
+    node = profile::attach(node, profile::label(rec));
     node = processor().run(node, rec);
     node = apply_slice(node, rec);
 
-    return Frame{df_ptr, std::move(node)};
+    Frame frame{df_ptr, std::move(node)};
+    frame.files = rec.files;
+    frame.progress = std::move(counter);
+    return frame;
+}
+//____________________________________________________________________________
+rarexsec::events::Index rarexsec::Hub::event_index(const Entry& rec, const std::string& index_path)
+{
+    return event_index(rec, index_path, events::Columns{});
+}
+//____________________________________________________________________________
+rarexsec::events::Index rarexsec::Hub::event_index(const Entry& rec, const std::string& index_path,
+                                                   const events::Columns& cols)
+{
+    if (rec.skimmed() && rec.skim_rntuple)
+        throw std::runtime_error("event index: RNTuple skims are not supported (" + rec.skim_tree + ")");
+    return rec.skimmed() ? events::Index::open(index_path, rec.skim_tree, rec.skim_files, cols)
+                         : events::Index::open(index_path, input_tree, rec.files, cols);
+}
+//____________________________________________________________________________
+rarexsec::Frame rarexsec::Hub::sample(const Entry& rec, const std::vector<events::Key>& keys,
+                                      const std::string& index_path)
+{
+    return sample(rec, keys, index_path, events::Columns{});
+}
+//____________________________________________________________________________
+rarexsec::Frame rarexsec::Hub::sample(const Entry& rec, const std::vector<events::Key>& keys,
+                                      const std::string& index_path, const events::Columns& cols)
+{
+    const auto idx = event_index(rec, index_path, cols);
+    const auto found = idx.locate(keys);
+    auto describe = [](const std::vector<events::Key>& ks) {
+        std::ostringstream os;
+        for (std::size_t i = 0; i < ks.size() && i < 5; ++i)
+            os << (i ? ", " : "") << ks[i].run << ":" << ks[i].sub << ":" << ks[i].evt;
+        if (ks.size() > 5)
+            os << ", ...";
+        return os.str();
+    };
+    if (!found.missing.empty())
+        std::cerr << "[Hub] " << found.missing.size() << " requested events not in " << profile::label(rec)
+                  << ": " << describe(found.missing) << '\n';
+    if (!found.duplicated.empty())
+        std::cerr << "[Hub] " << found.duplicated.size() << " requested events appear more than once in "
+                  << profile::label(rec) << ", reading every copy: " << describe(found.duplicated) << '\n';
+    return sample(rec, idx, found);
+}
+//____________________________________________________________________________
+rarexsec::Frame rarexsec::Hub::sample(const Entry& rec, const events::Index& idx, const events::Lookup& found)
+{
+    std::shared_ptr<TTree> chain = idx.chain(found);
+    auto df_ptr = std::make_shared<ROOT::RDataFrame>(*chain);
+    ROOT::RDF::RNode node = profile::attach(*df_ptr, profile::label(rec) + "/events");
+    if (!rec.skimmed())
+        node = processor().run(node, rec);
+
+    Frame frame{df_ptr, std::move(node)};
+    frame.source = std::move(chain);
+    frame.files = idx.files();
+    frame.scales = rec.skim_scales;
+    return frame;
 }
 //____________________________________________________________________________
 rarexsec::Hub::Hub(const std::string& path)
 {
+    memory::Stage stage("hub:" + path);
     std::ifstream cfg(path);
     if (!cfg)
         throw std::runtime_error("cannot open " + path);
     json j;
     cfg >> j;
 
+    std::string skim_path;
+    bool skim_dir = false;
+    snapshot::Options skim_opt;
+    std::unordered_map<std::string, std::string> skim_keys;
+    json skim_manifest;
+    std::vector<std::string> skim_columns = snapshot::default_columns();
+    bool skim_strict = false;
+    if (j.contains("skim")) {
+        const auto& sk = j.at("skim");
+        skim_path = sk.at("file").get<std::string>();
+        if (sk.contains("columns")) {
+            skim_columns = sk.at("columns").get<std::vector<std::string>>();
+            skim_strict = true;
+        }
+        skim_opt.tree = sk.value("tree", skim_opt.tree);
+        skim_dir = std::filesystem::is_directory(skim_path);
+        if (std::filesystem::path(skim_path).extension() == ".json") {
+            std::ifstream in(skim_path);
+            if (!in)
+                throw std::runtime_error("cannot open skim manifest " + skim_path);
+            in >> skim_manifest;
+            skim_opt.tree = sk.value("tree", skim_manifest.value("tree_prefix", skim_opt.tree));
+        } else if (!skim_dir) {
+            skim_keys = list_keys(skim_path);
+        }
+    }
+    auto use_skim = [&](Entry& target, const Entry& origin, const std::string& tag) {
+        target.skim_files.clear();
+        target.skim_tree.clear();
+        target.skim_rntuple = false;
+        target.skim_scales.clear();
+        if (skim_path.empty())
+            return;
+        const auto name = snapshot::make_tree_name(skim_opt, origin, tag);
+        if (skim_manifest.is_object()) {
+            const auto& trees = skim_manifest.at("trees");
+            auto it = trees.find(name);
+            if (it == trees.end())
+                return;
+            const auto base = std::filesystem::path(skim_path).parent_path();
+            for (const auto& f : it->at("files").get<std::vector<std::string>>()) {
+                const std::filesystem::path p(f);
+                target.skim_files.push_back(p.is_absolute() ? p.string() : (base / p).string());
+            }
+            target.skim_tree = name;
+            const auto prov = it->value("provenance", json::object());
+            target.skim_scales = provenance_scales(prov);
+            check_skim_columns(name, prov, skim_columns, skim_strict);
+            return;
+        }
+        auto file = skim_path;
+        if (skim_dir) {
+            file = (std::filesystem::path(skim_path) / (name + ".root")).string();
+            if (!std::filesystem::exists(file))
+                return;
+        }
+        std::unordered_map<std::string, std::string> file_keys;
+        if (skim_dir)
+            file_keys = list_keys(file);
+        const auto& keys = skim_dir ? file_keys : skim_keys;
+        auto it = keys.find(name);
+        if (it == keys.end())
+            return;
+        target.skim_files = {file};
+        target.skim_tree = name;
+        target.skim_rntuple = it->second.find("RNTuple") != std::string::npos;
+        const auto prov = read_provenance(file, name);
+        target.skim_scales = provenance_scales(prov);
+        check_skim_columns(name, prov, skim_columns, skim_strict);
+    };
+
     const auto& bl = j.at("beamlines");
     for (auto it_bl = bl.begin(); it_bl != bl.end(); ++it_bl) {
         const std::string beamline = it_bl.key();
@@ -112,6 +348,7 @@ rarexsec::Hub::Hub(const std::string& path)
                     rec.pot_eqv = s.value("pot_eff", 0.0);
                 }
 
+                use_skim(rec, rec, "");
                 rec.nominal = sample(rec);
 
                 if (s.contains("detvars")) {
@@ -129,6 +366,7 @@ rarexsec::Hub::Hub(const std::string& path)
                             Entry dv = rec;
                             dv.files = std::move(dv_files);
                             dv.file = dv.files.front();
+                            use_skim(dv, rec, tag);
                             rec.detvars.emplace(tag, sample(dv));
                         }
                     }
@@ -8,11 +8,28 @@
 
 namespace rarexsec {
 
+namespace events {
+struct Key;
+struct Columns;
+struct Lookup;
+class Index;
+}
+
 class Hub {
   public:
     explicit Hub(const std::string& path);
 
-    Frame sample(const Entry& rec) const;
+    static Frame sample(const Entry& rec);
+    // Reads only the requested events through the sample's event index; keys the
+    // index does not hold, or holds more than once, are reported on std::cerr.
+    static Frame sample(const Entry& rec, const std::vector<events::Key>& keys,
+                        const std::string& index_path = "");
+    static Frame sample(const Entry& rec, const std::vector<events::Key>& keys,
+                        const std::string& index_path, const events::Columns& cols);
+    static Frame sample(const Entry& rec, const events::Index& idx, const events::Lookup& found);
+    static events::Index event_index(const Entry& rec, const std::string& index_path = "");
+    static events::Index event_index(const Entry& rec, const std::string& index_path,
+                                     const events::Columns& cols);
 
     std::vector<const Entry*> simulation_entries(const std::string& beamline,
                                                  const std::vector<std::string>& periods) const;
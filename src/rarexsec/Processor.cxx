@@ -9,6 +9,14 @@
 namespace {
 constexpr double kRecognisedPurityMin = 0.5;
 constexpr double kRecognisedCompletenessMin = 0.1;
+// Bump whenever run() changes the columns it defines; snapshots key on it.
+constexpr int kProcessorVersion = 1;
+}
+
+//____________________________________________________________________________
+int rarexsec::Processor::version()
+{
+    return kProcessorVersion;
 }
 
 //____________________________________________________________________________
@@ -7,6 +7,7 @@ namespace rarexsec {
 class Processor {
   public:
     ROOT::RDF::RNode run(ROOT::RDF::RNode node, const rarexsec::Entry& rec) const;
+    static int version();
 };
 
 const Processor& processor();
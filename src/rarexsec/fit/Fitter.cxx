@@ -1,10 +1,57 @@
 #include "rarexsec/fit/Fitter.h"
+#include "rarexsec/fit/Kernels.h"
 
 #include "Math/Factory.h"
 #include "Math/Functor.h"
 #include "Math/Minimizer.h"
+#include "ROOT/TSeq.hxx"
+#include "ROOT/TThreadExecutor.hxx"
 #include "TH1.h"
+#include "TError.h"
 #include "TH1D.h"
+#include "TROOT.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <mutex>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr char kModelMagic[8] = {'R', 'X', 'F', 'I', 'T', 'M', 'D', '\0'};
+constexpr std::uint32_t kModelVersion = 4;
+
+enum ModelSection : std::uint32_t {
+  kChannels,
+  kProcs,
+  kNorms,
+  kShapes,
+  kData,
+  kYields,
+  kDeltas,
+  kMcRelVar,
+  kPois,
+  kNames,
+  kNumSections
+};
+
+struct ModelHeader {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t n_sections;
+  std::uint64_t offset[kNumSections];
+  std::uint64_t count[kNumSections];
+  double sigma_ref_pb;
+  double eps;
+};
+
+std::size_t align8(std::size_t n) { return (n + 7) & ~std::size_t(7); }
+
+} // namespace
 
 namespace rarexsec::internal::fit {
 
@@ -18,12 +65,16 @@ Fitter::Fitter(const Fitter &o)
       shape_nuis_(o.shape_nuis_),
       signal_label_(o.signal_label_),
       sigma_ref_pb_(o.sigma_ref_pb_),
-      mu_lo_(o.mu_lo_),
-      mu_hi_(o.mu_hi_),
+      pois_(o.pois_),
+      poi_rules_(o.poi_rules_),
       eps_(o.eps_),
+      mc_stat_(o.mc_stat_),
+      mc_stat_threshold_(o.mc_stat_threshold_),
+      log_terms_(o.log_terms_),
       n_pars_(o.n_pars_),
       par_names_(o.par_names_),
-      par_is_norm_(o.par_is_norm_) {}
+      par_is_norm_(o.par_is_norm_),
+      model_(o.model_) {}
 
 Fitter &Fitter::operator=(const Fitter &o) {
   if (this == &o) return *this;
@@ -34,12 +85,16 @@ Fitter &Fitter::operator=(const Fitter &o) {
   shape_nuis_ = o.shape_nuis_;
   signal_label_ = o.signal_label_;
   sigma_ref_pb_ = o.sigma_ref_pb_;
-  mu_lo_ = o.mu_lo_;
-  mu_hi_ = o.mu_hi_;
+  pois_ = o.pois_;
+  poi_rules_ = o.poi_rules_;
   eps_ = o.eps_;
+  mc_stat_ = o.mc_stat_;
+  mc_stat_threshold_ = o.mc_stat_threshold_;
+  log_terms_ = o.log_terms_;
   n_pars_ = o.n_pars_;
   par_names_ = o.par_names_;
   par_is_norm_ = o.par_is_norm_;
+  model_ = o.model_;
   return *this;
 }
 
@@ -145,14 +200,55 @@ void Fitter::set_sigma_ref(double sigma_ref_pb) { sigma_ref_pb_ = sigma_ref_pb;
 
 double Fitter::sigma_ref() const { return sigma_ref_pb_; }
 
-void Fitter::set_mu_bounds(double lo, double hi) {
-  mu_lo_ = lo;
-  mu_hi_ = hi;
+void Fitter::set_mu_bounds(double lo, double hi) { set_poi_bounds("mu", lo, hi); }
+
+void Fitter::add_poi(const std::string &name, double lo, double hi) {
+  ensure_mutable_("add_poi");
+  if (name.empty() || name.rfind("theta_", 0) == 0) throw std::invalid_argument("add_poi: invalid POI name '" + name + "'");
+  if (find_poi_(name)) throw std::runtime_error("POI already exists: " + name);
+  if (!(lo < hi)) throw std::invalid_argument("add_poi: lo < hi required");
+  pois_.push_back(Poi{name, lo, hi});
+}
+
+void Fitter::set_poi_bounds(const std::string &name, double lo, double hi) {
+  Poi *p = find_poi_(name);
+  if (!p) throw std::runtime_error("set_poi_bounds: unknown POI " + name);
+  if (!(lo < hi)) throw std::invalid_argument("set_poi_bounds: lo < hi required");
+  p->lo = lo;
+  p->hi = hi;
+}
+
+void Fitter::assign_poi(const std::string &poi, const std::string &channel, const std::string &process) {
+  ensure_mutable_("assign_poi");
+  if (!find_poi_(poi)) throw std::runtime_error("assign_poi: unknown POI " + poi);
+  if (!channel.empty() && !channels_.count(channel)) throw std::runtime_error("assign_poi: unknown channel " + channel);
+  if (!process.empty() && !all_processes_.count(process))
+    throw std::runtime_error("assign_poi: unknown process " + process);
+  if (!channel.empty() && !process.empty() && !has_proc_(channel, process))
+    throw std::runtime_error("assign_poi: unknown (channel, process): " + channel + "," + process);
+  poi_rules_.emplace_back(CPKey{channel, process}, poi);
+}
+
+std::vector<std::string> Fitter::poi_names() {
+  compile_();
+  return std::vector<std::string>(par_names_.begin(), par_names_.begin() + model_->poi_lo.size());
 }
 
 void Fitter::set_yield_floor(double eps) { eps_ = (eps > 0.0 ? eps : 1e-12); }
 
+void Fitter::set_mc_stat(bool enabled, double threshold) {
+  ensure_mutable_("set_mc_stat");
+  mc_stat_ = enabled;
+  mc_stat_threshold_ = std::max(0.0, threshold);
+}
+
+void Fitter::set_fast_log(bool enabled, double tolerance) {
+  if (enabled && !(tolerance > 0.0)) throw std::invalid_argument("set_fast_log: tolerance must be > 0");
+  log_terms_ = (enabled ? kernels::log_terms_for_tolerance(tolerance) : 0);
+}
+
 void Fitter::add_channel(const std::string &channel, const TH1 *h_data) {
+  ensure_mutable_("add_channel");
   if (!h_data) throw std::invalid_argument("add_channel: data histogram is null");
   if (channels_.count(channel)) throw std::runtime_error("channel already exists: " + channel);
   Channel ch;
@@ -164,6 +260,7 @@ void Fitter::add_channel(const std::string &channel, const TH1 *h_data) {
 
 void Fitter::add_process(const std::string &channel, const std::string &process, const TH1 *h_nominal,
                          bool is_signal) {
+  ensure_mutable_("add_process");
   auto it = channels_.find(channel);
   if (it == channels_.end()) throw std::runtime_error("add_process: unknown channel " + channel);
   if (!h_nominal) throw std::invalid_argument("add_process: nominal histogram is null");
@@ -181,6 +278,7 @@ void Fitter::add_process(const std::string &channel, const std::string &process,
 }
 
 void Fitter::mark_signal_process(const std::string &process) {
+  ensure_mutable_("mark_signal_process");
   signal_label_ = process;
   for (auto &kv : channels_) {
     for (auto &pkv : kv.second.processes) {
@@ -190,6 +288,7 @@ void Fitter::mark_signal_process(const std::string &process) {
 }
 
 void Fitter::add_norm_systematic(const std::string &name, bool log_normal) {
+  ensure_mutable_("add_norm_systematic");
   if (norm_nuis_.count(name)) throw std::runtime_error("norm nuisance already exists: " + name);
   NormNuisance nn;
   nn.name = name;
@@ -199,6 +298,7 @@ void Fitter::add_norm_systematic(const std::string &name, bool log_normal) {
 
 void Fitter::set_norm_effect(const std::string &name, const std::string &channel, const std::string &process,
                              double frac) {
+  ensure_mutable_("set_norm_effect");
   auto it = norm_nuis_.find(name);
   if (it == norm_nuis_.end()) throw std::runtime_error("unknown norm nuisance: " + name);
   if (!has_proc_(channel, process))
@@ -208,6 +308,7 @@ void Fitter::set_norm_effect(const std::string &name, const std::string &channel
 }
 
 void Fitter::add_shape_systematic(const std::string &name) {
+  ensure_mutable_("add_shape_systematic");
   if (shape_nuis_.count(name)) throw std::runtime_error("shape nuisance already exists: " + name);
   ShapeNuisance sn;
   sn.name = name;
@@ -216,6 +317,7 @@ void Fitter::add_shape_systematic(const std::string &name) {
 
 void Fitter::set_shape_effect(const std::string &name, const std::string &channel, const std::string &process,
                               const TH1 *h_up, const TH1 *h_down) {
+  ensure_mutable_("set_shape_effect");
   auto it = shape_nuis_.find(name);
   if (it == shape_nuis_.end()) throw std::runtime_error("unknown shape nuisance: " + name);
   if (!has_proc_(channel, process))
@@ -230,48 +332,19 @@ void Fitter::set_shape_effect(const std::string &name, const std::string &channe
 }
 
 Fitter::FitResult Fitter::fit(const std::string &minimizer, const std::string &algo, bool verbose) {
-  if (channels_.empty()) throw std::runtime_error("fit: no channels added");
-  if (!has_any_signal_()) throw std::runtime_error("fit: no signal process marked");
-  build_parameter_indexing_();
-  std::unique_ptr<ROOT::Math::Minimizer> min{ROOT::Math::Factory::CreateMinimizer(minimizer.c_str(),
-                                                                                 algo.c_str())};
-  if (!min) throw std::runtime_error("failed to create ROOT::Math::Minimizer");
-  min->SetPrintLevel(verbose ? 1 : 0);
-  min->SetStrategy(1);
-  min->SetMaxFunctionCalls(100000);
-  min->SetMaxIterations(100000);
-  min->SetTolerance(1e-4);
-  ROOT::Math::Functor f(this, &Fitter::nll_, n_pars_);
-  min->SetFunction(f);
-  min->SetLimitedVariable(0, "mu", std::clamp(guess_mu_(), mu_lo_, mu_hi_), 0.1, mu_lo_, mu_hi_);
-  for (std::size_t i = 1; i < n_pars_; ++i)
-    min->SetVariable(static_cast<int>(i), par_names_[i].c_str(), 0.0, 0.1);
-  bool ok = min->Minimize();
-  FitResult fr;
-  fr.status = min->Status();
-  fr.nll = min->MinValue() / 2.0;
-  const double *xs = min->X();
-  const double *xe = min->Errors();
-  if (ok && xs) {
-    fr.mu = xs[0];
-    fr.mu_err_sym = (xe ? xe[0] : std::numeric_limits<double>::quiet_NaN());
-    for (std::size_t i = 1; i < n_pars_; ++i) {
-      fr.nuis_values[par_names_[i]] = xs[i];
-      if (xe) fr.nuis_errors[par_names_[i]] = xe[i];
-    }
-  }
-  min->Hesse();
-  if (min->Errors()) fr.mu_err_sym = min->Errors()[0];
-  return fr;
+  if (channels_.empty() && !model_) throw std::runtime_error("fit: no channels added");
+  compile_();
+  return minimise_(*model_, initial_pars_(*model_), -1, minimizer, algo, verbose, true);
 }
 
 std::vector<std::pair<double, double>> Fitter::scan_delta_nll(double mu_min, double mu_max, int npts,
                                                               const std::string &minimizer,
                                                               const std::string &algo,
-                                                              bool verbose) {
+                                                              bool verbose, const std::string &poi) {
   if (mu_min >= mu_max) throw std::invalid_argument("scan_delta_nll: mu_min < mu_max required");
   if (npts < 3) throw std::invalid_argument("scan_delta_nll: npts >= 3 required");
-  build_parameter_indexing_();
+  compile_();
+  const int k = poi_index_(poi);
   std::unique_ptr<ROOT::Math::Minimizer> min{ROOT::Math::Factory::CreateMinimizer(minimizer.c_str(),
                                                                                  algo.c_str())};
   if (!min) throw std::runtime_error("failed to create ROOT::Math::Minimizer");
@@ -280,20 +353,23 @@ std::vector<std::pair<double, double>> Fitter::scan_delta_nll(double mu_min, dou
   min->SetMaxFunctionCalls(200000);
   min->SetMaxIterations(200000);
   min->SetTolerance(1e-4);
-  ROOT::Math::Functor f(this, &Fitter::nll_, n_pars_);
+  std::shared_ptr<const Model> model = model_;
+  ROOT::Math::Functor f([model](const double *x) { return nll_(*model, x); }, n_pars_);
   min->SetFunction(f);
-  double mu0 = std::clamp(guess_mu_(), mu_lo_, mu_hi_);
-  min->SetLimitedVariable(0, "mu", mu0, 0.1, mu_lo_, mu_hi_);
-  min->FixVariable(0);
-  for (std::size_t i = 1; i < n_pars_; ++i)
+  const std::vector<double> x0 = initial_pars_(*model);
+  const std::size_t n_poi = model->poi_lo.size();
+  for (std::size_t i = 0; i < n_poi; ++i)
+    min->SetLimitedVariable(static_cast<int>(i), par_names_[i].c_str(), x0[i], 0.1, model->poi_lo[i], model->poi_hi[i]);
+  for (std::size_t i = n_poi; i < n_pars_; ++i)
     min->SetVariable(static_cast<int>(i), par_names_[i].c_str(), 0.0, 0.1);
+  min->FixVariable(k);
   double nll_min_global = get_nll_min_free_mu_(minimizer, algo, verbose);
   std::vector<std::pair<double, double>> out;
   out.reserve(npts);
   for (int ip = 0; ip < npts; ++ip) {
     const double mu = mu_min + (mu_max - mu_min) * (double(ip) / double(npts - 1));
-    min->SetVariableValue(0, mu);
-    min->FixVariable(0);
+    min->SetVariableValue(k, mu);
+    min->FixVariable(k);
     min->Minimize();
     double nll = min->MinValue() / 2.0;
     out.emplace_back(mu, std::max(0.0, nll - nll_min_global));
@@ -301,6 +377,77 @@ std::vector<std::pair<double, double>> Fitter::scan_delta_nll(double mu_min, dou
   return out;
 }
 
+std::vector<Fitter::Impact> Fitter::impacts(const std::string &minimizer, const std::string &algo, unsigned nthreads,
+                                            bool verbose, const std::string &poi) {
+  const FitResult best = fit(minimizer, algo, verbose);
+  const std::string &poi_name = par_names_[poi_index_(poi)];
+  auto poi_value = [&poi_name](const FitResult &fr) {
+    auto it = fr.poi_values.find(poi_name);
+    return it != fr.poi_values.end() ? it->second : std::numeric_limits<double>::quiet_NaN();
+  };
+  const double poi_hat = poi_value(best);
+  if (!std::isfinite(poi_hat)) throw std::runtime_error("impacts: nominal fit failed");
+  std::shared_ptr<const Model> model = model_;
+  const std::size_t n_poi = model->poi_lo.size();
+  std::vector<double> xhat(n_pars_, 0.0);
+  std::vector<double> err(n_pars_, 1.0);
+  for (std::size_t i = 0; i < n_poi; ++i) xhat[i] = best.poi_values.at(par_names_[i]);
+  for (std::size_t i = n_poi; i < n_pars_; ++i) {
+    xhat[i] = best.nuis_values.at(par_names_[i]);
+    auto it = best.nuis_errors.find(par_names_[i]);
+    if (it != best.nuis_errors.end() && std::isfinite(it->second) && it->second > 0.0) err[i] = it->second;
+  }
+  struct Shift {
+    std::size_t par;
+    double value;
+  };
+  std::vector<Shift> shifts;
+  shifts.reserve(4 * (n_pars_ - n_poi));
+  for (std::size_t i = n_poi; i < n_pars_; ++i) {
+    shifts.push_back({i, xhat[i] + 1.0});
+    shifts.push_back({i, xhat[i] - 1.0});
+    shifts.push_back({i, xhat[i] + err[i]});
+    shifts.push_back({i, xhat[i] - err[i]});
+  }
+  std::vector<double> dmu;
+  if (!shifts.empty()) {
+    ROOT::EnableThreadSafety();
+    ROOT::TThreadExecutor pool(nthreads);
+    dmu = pool.Map(
+        [&](unsigned is) {
+          std::vector<double> x0 = xhat;
+          x0[shifts[is].par] = shifts[is].value;
+          const FitResult fr =
+              minimise_(*model, x0, static_cast<int>(shifts[is].par), minimizer, algo, false, false);
+          if (fr.status != 0 && fr.status != 1) return std::numeric_limits<double>::quiet_NaN();
+          return poi_value(fr) - poi_hat;
+        },
+        ROOT::TSeqU(static_cast<unsigned>(shifts.size())));
+  }
+  std::vector<Impact> out;
+  out.reserve(n_pars_ - n_poi);
+  for (std::size_t i = n_poi; i < n_pars_; ++i) {
+    const std::size_t k = 4 * (i - n_poi);
+    Impact im;
+    im.name = par_names_[i];
+    im.theta = xhat[i];
+    im.theta_err = err[i];
+    im.prefit_up = dmu[k];
+    im.prefit_down = dmu[k + 1];
+    im.postfit_up = dmu[k + 2];
+    im.postfit_down = dmu[k + 3];
+    im.failed = !std::all_of(dmu.begin() + k, dmu.begin() + k + 4, [](double d) { return std::isfinite(d); });
+    out.push_back(std::move(im));
+  }
+  // Parameters whose refits failed rank NaN; they go last instead of breaking the ordering.
+  std::stable_sort(out.begin(), out.end(), [](const Impact &a, const Impact &b) {
+    const bool na = std::isnan(a.rank()), nb = std::isnan(b.rank());
+    if (na || nb) return !na && nb;
+    return a.rank() > b.rank();
+  });
+  return out;
+}
+
 double Fitter::cross_section_pb(const FitResult &fr) const { return fr.mu * sigma_ref_pb_; }
 
 double Fitter::cross_section_err_sym_pb(const FitResult &fr) const { return fr.mu_err_sym * sigma_ref_pb_; }
@@ -337,11 +484,18 @@ bool Fitter::has_proc_(const std::string &ch, const std::string &pr) const {
   return it->second.processes.count(pr) != 0;
 }
 
-bool Fitter::has_any_signal_() const {
-  for (auto const &ckv : channels_)
-    for (auto const &pkv : ckv.second.processes)
-      if (pkv.second.is_signal) return true;
-  return false;
+int Fitter::poi_index_(const std::string &poi) const {
+  const std::size_t n_poi = model_ ? model_->poi_lo.size() : 0;
+  if (poi.empty() && n_poi > 0) return 0;
+  for (std::size_t i = 0; i < n_poi; ++i)
+    if (par_names_[i] == poi) return static_cast<int>(i);
+  throw std::runtime_error("unknown POI: " + poi);
+}
+
+Fitter::Poi *Fitter::find_poi_(const std::string &name) {
+  for (auto &p : pois_)
+    if (p.name == name) return &p;
+  return nullptr;
 }
 
 void Fitter::clear_() {
@@ -353,13 +507,21 @@ void Fitter::clear_() {
   par_names_.clear();
   par_is_norm_.clear();
   n_pars_ = 0;
+  model_.reset();
 }
 
-void Fitter::build_parameter_indexing_() {
+void Fitter::ensure_mutable_(const char *what) const {
+  if (model_ && channels_.empty())
+    throw std::logic_error(std::string(what) + ": the model was loaded from file and cannot be modified");
+}
+
+void Fitter::build_parameter_indexing_(const std::vector<const Poi *> &pois) {
   par_names_.clear();
   par_is_norm_.clear();
-  par_names_.push_back("mu");
-  par_is_norm_.push_back(0);
+  for (const Poi *p : pois) {
+    par_names_.push_back(p->name);
+    par_is_norm_.push_back(0);
+  }
   for (auto &kv : norm_nuis_) {
     kv.second.index = static_cast<int>(par_names_.size());
     par_names_.push_back("theta_norm_" + kv.first);
@@ -373,15 +535,275 @@ void Fitter::build_parameter_indexing_() {
   n_pars_ = par_names_.size();
 }
 
-double Fitter::guess_mu_() const {
-  double s = 0.0, b = 0.0, d = 0.0;
+void Fitter::compile_() {
+  if (channels_.empty()) {
+    if (!model_) throw std::runtime_error("compile: no channels added");
+    auto m = std::make_shared<Model>(*model_);
+    for (std::size_t i = 0; i < m->poi_lo.size(); ++i) {
+      if (const Poi *p = find_poi_(m->par_names[i])) {
+        m->poi_lo[i] = p->lo;
+        m->poi_hi[i] = p->hi;
+      }
+    }
+    m->eps = eps_;
+    m->log_terms = log_terms_;
+    par_names_ = m->par_names;
+    par_is_norm_.clear();
+    for (std::size_t i = 0; i < par_names_.size(); ++i) {
+      const std::string &name = par_names_[i];
+      par_is_norm_.push_back(i < m->poi_lo.size() ? 0 : (name.rfind("theta_norm_", 0) == 0 ? 1 : 2));
+    }
+    n_pars_ = par_names_.size();
+    model_ = std::move(m);
+    return;
+  }
+  std::map<CPKey, std::string> assigned;
+  std::set<std::string> used;
+  for (auto const &ckv : channels_) {
+    for (auto const &pkv : ckv.second.processes) {
+      const Process &proc = pkv.second;
+      std::string poi = proc.is_signal ? pois_.front().name : std::string();
+      for (auto const &r : poi_rules_) {
+        if ((r.first.ch.empty() || r.first.ch == ckv.first) && (r.first.pr.empty() || r.first.pr == proc.name) &&
+            (!r.first.pr.empty() || proc.is_signal))
+          poi = r.second;
+      }
+      if (poi.empty()) continue;
+      assigned[CPKey{ckv.first, proc.name}] = poi;
+      used.insert(poi);
+    }
+  }
+  if (used.empty()) throw std::runtime_error("compile: no signal process marked");
+  std::vector<const Poi *> active;
+  for (auto const &p : pois_) {
+    if (used.count(p.name))
+      active.push_back(&p);
+    else if (&p != &pois_.front())
+      throw std::runtime_error("compile: POI has no signal processes: " + p.name);
+    else
+      ::Warning("Fitter::compile", "POI %s has no signal processes and is dropped; FitResult::mu and the "
+                "cross sections are NaN, read poi_values instead", p.name.c_str());
+  }
+  build_parameter_indexing_(active);
+  std::map<std::string, std::int32_t> poi_index;
+  ModelTables t;
+  t.par_names = par_names_;
+  for (const Poi *p : active) {
+    poi_index[p->name] = static_cast<std::int32_t>(poi_index.size());
+    t.poi_bounds.push_back(p->lo);
+    t.poi_bounds.push_back(p->hi);
+  }
   for (auto const &ckv : channels_) {
-    const auto &ch = ckv.second;
-    d += ch.data->Integral(1, ch.data->GetNbinsX());
+    const Channel &ch = ckv.second;
+    Model::Bins cb;
+    cb.bin0 = static_cast<std::int32_t>(t.data.size());
+    cb.nbins = ch.nbins;
+    cb.proc0 = static_cast<std::int32_t>(t.procs.size());
+    for (int ib = 1; ib <= ch.nbins; ++ib) t.data.push_back(ch.data->GetBinContent(ib));
     for (auto const &pkv : ch.processes) {
-      const auto &p = pkv.second;
-      const double y = p.nominal->Integral(1, p.nominal->GetNbinsX());
-      if (p.is_signal)
+      const Process &proc = pkv.second;
+      const CPKey key{ch.name, proc.name};
+      Model::Proc mp;
+      auto ait = assigned.find(key);
+      mp.poi = (ait != assigned.end() ? poi_index.at(ait->second) : -1);
+      mp.yield0 = static_cast<std::int32_t>(t.yields.size());
+      for (int ib = 1; ib <= ch.nbins; ++ib) t.yields.push_back(proc.nominal->GetBinContent(ib));
+      mp.norm0 = static_cast<std::int32_t>(t.norms.size());
+      for (auto const &nnkv : norm_nuis_) {
+        auto it = nnkv.second.frac.find(key);
+        if (it != nnkv.second.frac.end())
+          t.norms.push_back(Model::NormTerm{nnkv.second.index, nnkv.second.log_normal ? 1 : 0, it->second});
+      }
+      mp.norm1 = static_cast<std::int32_t>(t.norms.size());
+      mp.shape0 = static_cast<std::int32_t>(t.shapes.size());
+      for (auto const &snkv : shape_nuis_) {
+        auto it = snkv.second.updown.find(key);
+        if (it == snkv.second.updown.end()) continue;
+        t.shapes.push_back(Model::ShapeTerm{snkv.second.index, static_cast<std::int32_t>(t.deltas.size())});
+        for (int ib = 1; ib <= ch.nbins; ++ib)
+          t.deltas.push_back(0.5 * (it->second.first->GetBinContent(ib) - it->second.second->GetBinContent(ib)));
+      }
+      mp.shape1 = static_cast<std::int32_t>(t.shapes.size());
+      t.procs.push_back(mp);
+    }
+    cb.proc1 = static_cast<std::int32_t>(t.procs.size());
+    t.channels.push_back(cb);
+    if (!mc_stat_) continue;
+    for (int ib = 1; ib <= ch.nbins; ++ib) {
+      double nu = 0.0, sumw2 = 0.0;
+      for (auto const &pkv : ch.processes) {
+        nu += pkv.second.nominal->GetBinContent(ib);
+        const double e = pkv.second.nominal->GetBinError(ib);
+        sumw2 += e * e;
+      }
+      const double rel = (nu > 0.0 ? std::sqrt(sumw2) / nu : 0.0);
+      t.mc_rel_var.push_back(std::isfinite(rel) && rel > mc_stat_threshold_ ? rel * rel : 0.0);
+    }
+  }
+  auto m = std::make_shared<Model>(pack_model_(t));
+  m->eps = eps_;
+  m->log_terms = log_terms_;
+  model_ = std::move(m);
+}
+
+Fitter::Model Fitter::pack_model_(const ModelTables &t) {
+  ModelHeader hdr{};
+  std::memcpy(hdr.magic, kModelMagic, sizeof(kModelMagic));
+  hdr.version = kModelVersion;
+  hdr.n_sections = kNumSections;
+  hdr.sigma_ref_pb = 1.0;
+  hdr.eps = 1e-9;
+  std::string names;
+  for (auto const &n : t.par_names) names += n + '\0';
+  const std::size_t sizes[kNumSections] = {
+      t.channels.size() * sizeof(Model::Bins), t.procs.size() * sizeof(Model::Proc),
+      t.norms.size() * sizeof(Model::NormTerm), t.shapes.size() * sizeof(Model::ShapeTerm),
+      t.data.size() * sizeof(double),           t.yields.size() * sizeof(double),
+      t.deltas.size() * sizeof(double),         t.mc_rel_var.size() * sizeof(double),
+      t.poi_bounds.size() * sizeof(double),     names.size()};
+  const void *src[kNumSections] = {t.channels.data(), t.procs.data(),  t.norms.data(),
+                                   t.shapes.data(),   t.data.data(),   t.yields.data(),
+                                   t.deltas.data(),   t.mc_rel_var.data(), t.poi_bounds.data(),
+                                   names.data()};
+  const std::size_t counts[kNumSections] = {t.channels.size(), t.procs.size(),  t.norms.size(),
+                                            t.shapes.size(),   t.data.size(),   t.yields.size(),
+                                            t.deltas.size(),   t.mc_rel_var.size(), t.poi_bounds.size(),
+                                            names.size()};
+  std::size_t bytes = align8(sizeof(ModelHeader));
+  for (std::uint32_t i = 0; i < kNumSections; ++i) {
+    hdr.offset[i] = bytes;
+    hdr.count[i] = counts[i];
+    bytes = align8(bytes + sizes[i]);
+  }
+  auto buf = std::make_shared<std::vector<std::uint64_t>>(bytes / sizeof(std::uint64_t), 0);
+  auto *image = reinterpret_cast<unsigned char *>(buf->data());
+  std::memcpy(image, &hdr, sizeof(hdr));
+  for (std::uint32_t i = 0; i < kNumSections; ++i)
+    if (sizes[i]) std::memcpy(image + hdr.offset[i], src[i], sizes[i]);
+  return view_model_(image, bytes, std::move(buf));
+}
+
+Fitter::Model Fitter::view_model_(const unsigned char *image, std::size_t bytes,
+                                  std::shared_ptr<const void> storage) {
+  if (bytes < sizeof(ModelHeader)) throw std::runtime_error("fit model: truncated header");
+  ModelHeader hdr;
+  std::memcpy(&hdr, image, sizeof(hdr));
+  if (std::memcmp(hdr.magic, kModelMagic, sizeof(kModelMagic)) != 0)
+    throw std::runtime_error("fit model: bad magic");
+  if (hdr.version != kModelVersion || hdr.n_sections != kNumSections)
+    throw std::runtime_error("fit model: unsupported version " + std::to_string(hdr.version));
+  const std::size_t elem[kNumSections] = {sizeof(Model::Bins), sizeof(Model::Proc), sizeof(Model::NormTerm),
+                                          sizeof(Model::ShapeTerm), sizeof(double), sizeof(double),
+                                          sizeof(double), sizeof(double), sizeof(double), 1};
+  for (std::uint32_t i = 0; i < kNumSections; ++i) {
+    if (hdr.offset[i] % 8 != 0 || hdr.offset[i] > bytes || hdr.count[i] > (bytes - hdr.offset[i]) / elem[i])
+      throw std::runtime_error("fit model: section " + std::to_string(i) + " out of bounds");
+  }
+  Model m;
+  m.channels = {reinterpret_cast<const Model::Bins *>(image + hdr.offset[kChannels]), hdr.count[kChannels]};
+  m.procs = {reinterpret_cast<const Model::Proc *>(image + hdr.offset[kProcs]), hdr.count[kProcs]};
+  m.norms = {reinterpret_cast<const Model::NormTerm *>(image + hdr.offset[kNorms]), hdr.count[kNorms]};
+  m.shapes = {reinterpret_cast<const Model::ShapeTerm *>(image + hdr.offset[kShapes]), hdr.count[kShapes]};
+  m.data = {reinterpret_cast<const double *>(image + hdr.offset[kData]), hdr.count[kData]};
+  m.yields = {reinterpret_cast<const double *>(image + hdr.offset[kYields]), hdr.count[kYields]};
+  m.deltas = {reinterpret_cast<const double *>(image + hdr.offset[kDeltas]), hdr.count[kDeltas]};
+  m.mc_rel_var = {reinterpret_cast<const double *>(image + hdr.offset[kMcRelVar]), hdr.count[kMcRelVar]};
+  m.poi_bounds = {reinterpret_cast<const double *>(image + hdr.offset[kPois]), hdr.count[kPois]};
+  const char *names = reinterpret_cast<const char *>(image + hdr.offset[kNames]);
+  for (std::size_t i = 0, start = 0; i < hdr.count[kNames]; ++i) {
+    if (names[i] != '\0') continue;
+    m.par_names.emplace_back(names + start, i - start);
+    start = i + 1;
+  }
+  const auto n_pars = static_cast<std::int32_t>(m.par_names.size());
+  const auto n_poi = static_cast<std::int32_t>(m.poi_bounds.size() / 2);
+  if (m.poi_bounds.size() % 2 != 0 || n_poi < 1 || n_poi > n_pars)
+    throw std::runtime_error("fit model: corrupt POI table");
+  for (std::int32_t i = 0; i < n_poi; ++i) {
+    m.poi_lo.push_back(m.poi_bounds[2 * i]);
+    m.poi_hi.push_back(m.poi_bounds[2 * i + 1]);
+  }
+  if (!m.mc_rel_var.empty() && m.mc_rel_var.size() != m.data.size())
+    throw std::runtime_error("fit model: mc stat table does not match data bins");
+  for (std::size_t ic = 0; ic < m.channels.size(); ++ic) {
+    const auto &ch = m.channels[ic];
+    if (ch.bin0 < 0 || ch.nbins < 0 || std::size_t(ch.bin0) + ch.nbins > m.data.size() || ch.proc0 < 0 ||
+        ch.proc1 < ch.proc0 || std::size_t(ch.proc1) > m.procs.size())
+      throw std::runtime_error("fit model: corrupt channel table");
+    for (std::int32_t ip = ch.proc0; ip < ch.proc1; ++ip) {
+      const auto &p = m.procs[ip];
+      if (p.yield0 < 0 || std::size_t(p.yield0) + ch.nbins > m.yields.size() || p.norm0 < 0 ||
+          p.norm1 < p.norm0 || std::size_t(p.norm1) > m.norms.size() || p.shape0 < 0 || p.shape1 < p.shape0 ||
+          std::size_t(p.shape1) > m.shapes.size() || p.poi < -1 || p.poi >= n_poi)
+        throw std::runtime_error("fit model: corrupt process table");
+      for (std::int32_t in = p.norm0; in < p.norm1; ++in)
+        if (m.norms[in].par < n_poi || m.norms[in].par >= n_pars) throw std::runtime_error("fit model: corrupt norm table");
+      for (std::int32_t is = p.shape0; is < p.shape1; ++is)
+        if (m.shapes[is].par < n_poi || m.shapes[is].par >= n_pars || m.shapes[is].delta0 < 0 ||
+            std::size_t(m.shapes[is].delta0) + ch.nbins > m.deltas.size())
+          throw std::runtime_error("fit model: corrupt shape table");
+    }
+  }
+  m.image = image;
+  m.image_bytes = bytes;
+  m.storage = std::move(storage);
+  return m;
+}
+
+void Fitter::save_model(const std::string &path) {
+  compile_();
+  const std::string tmp = path + ".tmp";
+  {
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    if (!out) throw std::runtime_error("save_model: cannot open " + tmp);
+    ModelHeader hdr;
+    std::memcpy(&hdr, model_->image, sizeof(hdr));
+    hdr.sigma_ref_pb = sigma_ref_pb_;
+    hdr.eps = eps_;
+    out.write(reinterpret_cast<const char *>(&hdr), sizeof(hdr));
+    out.write(reinterpret_cast<const char *>(model_->image) + sizeof(hdr),
+              static_cast<std::streamsize>(model_->image_bytes - sizeof(hdr)));
+    if (!out) throw std::runtime_error("save_model: write failed for " + tmp);
+  }
+  if (std::rename(tmp.c_str(), path.c_str()) != 0) throw std::runtime_error("save_model: cannot rename to " + path);
+}
+
+Fitter Fitter::load_model(const std::string &path) {
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) throw std::runtime_error("load_model: cannot open " + path);
+  struct stat st;
+  if (::fstat(fd, &st) != 0 || st.st_size <= 0) {
+    ::close(fd);
+    throw std::runtime_error("load_model: cannot stat " + path);
+  }
+  const auto bytes = static_cast<std::size_t>(st.st_size);
+  void *addr = ::mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (addr == MAP_FAILED) throw std::runtime_error("load_model: mmap failed for " + path);
+  std::shared_ptr<const void> storage(addr, [bytes](const void *p) { ::munmap(const_cast<void *>(p), bytes); });
+  Fitter f;
+  f.model_ = std::make_shared<Model>(view_model_(static_cast<const unsigned char *>(addr), bytes, std::move(storage)));
+  ModelHeader hdr;
+  std::memcpy(&hdr, addr, sizeof(hdr));
+  f.sigma_ref_pb_ = hdr.sigma_ref_pb;
+  f.eps_ = hdr.eps;
+  f.pois_.clear();
+  for (std::size_t i = 0; i < f.model_->poi_lo.size(); ++i)
+    f.pois_.push_back(Poi{f.model_->par_names[i], f.model_->poi_lo[i], f.model_->poi_hi[i]});
+  f.compile_();
+  return f;
+}
+
+std::vector<double> Fitter::initial_pars_(const Model &m) {
+  double s = 0.0, b = 0.0, d = 0.0;
+  for (std::size_t ic = 0; ic < m.channels.size(); ++ic) {
+    const auto &ch = m.channels[ic];
+    for (std::int32_t ib = 0; ib < ch.nbins; ++ib) d += m.data[ch.bin0 + ib];
+    for (std::int32_t ip = ch.proc0; ip < ch.proc1; ++ip) {
+      const auto &p = m.procs[ip];
+      double y = 0.0;
+      for (std::int32_t ib = 0; ib < ch.nbins; ++ib) y += m.yields[p.yield0 + ib];
+      if (p.poi >= 0)
         s += y;
       else
         b += y;
@@ -389,82 +811,127 @@ double Fitter::guess_mu_() const {
   }
   double mu = (s > 0.0 ? (d - b) / s : 1.0);
   if (!std::isfinite(mu)) mu = 1.0;
-  return std::clamp(mu, mu_lo_, mu_hi_);
+  std::vector<double> x0(m.par_names.size(), 0.0);
+  for (std::size_t i = 0; i < m.poi_lo.size(); ++i) x0[i] = std::clamp(mu, m.poi_lo[i], m.poi_hi[i]);
+  return x0;
 }
 
-double Fitter::nll_(const double *x) const {
-  const double mu = std::clamp(x[0], mu_lo_, mu_hi_);
+double Fitter::nll_(const Model &m, const double *x) {
   double logl = 0.0;
-  for (auto const &kv : norm_nuis_) {
-    const double th = x[kv.second.index];
-    logl += -0.5 * th * th;
-  }
-  for (auto const &kv : shape_nuis_) {
-    const double th = x[kv.second.index];
-    logl += -0.5 * th * th;
-  }
-  for (auto const &ckv : channels_) {
-    const Channel &ch = ckv.second;
-    for (int ib = 1; ib <= ch.nbins; ++ib) {
-      double nu = 0.0;
-      for (auto const &pkv : ch.processes) {
-        const Process &proc = pkv.second;
-        double y = proc.nominal->GetBinContent(ib);
-        for (auto const &snkv : shape_nuis_) {
-          const ShapeNuisance &sn = snkv.second;
-          auto it = sn.updown.find(CPKey{ch.name, proc.name});
-          if (it != sn.updown.end()) {
-            const double th = x[sn.index];
-            const double yup = it->second.first->GetBinContent(ib);
-            const double ydn = it->second.second->GetBinContent(ib);
-            const double delta = 0.5 * (yup - ydn);
-            y += th * delta;
-          }
-        }
-        if (y < 0.0) y = 0.0;
-        double scale = 1.0;
-        for (auto const &nnkv : norm_nuis_) {
-          const NormNuisance &nn = nnkv.second;
-          auto it = nn.frac.find(CPKey{ch.name, proc.name});
-          if (it != nn.frac.end()) {
-            const double th = x[nn.index];
-            const double f = it->second;
-            if (nn.log_normal)
-              scale *= std::exp(std::log(1.0 + f) * th);
-            else
-              scale *= std::max(0.0, 1.0 + f * th);
-          }
-        }
-        const double term = (proc.is_signal ? mu * scale * y : scale * y);
-        nu += term;
+  for (std::size_t i = m.poi_lo.size(); i < m.par_names.size(); ++i) logl += -0.5 * x[i] * x[i];
+  thread_local std::vector<double> nu, y, lg;
+  const std::size_t nb = m.data.size();
+  nu.assign(nb, 0.0);
+  for (std::size_t ic = 0; ic < m.channels.size(); ++ic) {
+    const Model::Bins &ch = m.channels[ic];
+    double *nu_ch = nu.data() + ch.bin0;
+    for (int ip = ch.proc0; ip < ch.proc1; ++ip) {
+      const Model::Proc &proc = m.procs[ip];
+      double scale = (proc.poi >= 0 ? std::clamp(x[proc.poi], m.poi_lo[proc.poi], m.poi_hi[proc.poi]) : 1.0);
+      for (int in = proc.norm0; in < proc.norm1; ++in) {
+        const Model::NormTerm &nt = m.norms[in];
+        const double th = x[nt.par];
+        if (nt.log_normal)
+          scale *= std::exp(std::log(1.0 + nt.frac) * th);
+        else
+          scale *= std::max(0.0, 1.0 + nt.frac * th);
       }
-      const double nobs = ch.data->GetBinContent(ib);
-      const double ex = (nu > eps_ ? nu : eps_);
-      if (nobs > 0.0)
-        logl += nobs * std::log(ex) - ex;
-      else
-        logl += -ex;
+      const double *y0 = &m.yields[proc.yield0];
+      y.assign(y0, y0 + ch.nbins);
+      for (int is = proc.shape0; is < proc.shape1; ++is) {
+        const Model::ShapeTerm &st = m.shapes[is];
+        const double th = x[st.par];
+        const double *d = &m.deltas[st.delta0];
+        for (int ib = 0; ib < ch.nbins; ++ib) y[ib] += th * d[ib];
+      }
+      for (int ib = 0; ib < ch.nbins; ++ib) nu_ch[ib] += scale * std::max(0.0, y[ib]);
+    }
+  }
+  if (!m.mc_rel_var.empty()) {
+    for (std::size_t ib = 0; ib < nb; ++ib) {
+      const double s2 = m.mc_rel_var[ib];
+      if (!(s2 > 0.0)) continue;
+      const double b = 1.0 - nu[ib] * s2;
+      const double gamma = 0.5 * (b + std::sqrt(b * b + 4.0 * m.data[ib] * s2));
+      logl += -0.5 * (gamma - 1.0) * (gamma - 1.0) / s2;
+      nu[ib] *= gamma;
     }
   }
+  for (std::size_t ib = 0; ib < nb; ++ib) nu[ib] = (nu[ib] > m.eps ? nu[ib] : m.eps);
+  lg.resize(nb);
+  kernels::log_n(nu.data(), lg.data(), nb, m.log_terms);
+  const double *nobs = &m.data[0];
+  for (std::size_t ib = 0; ib < nb; ++ib) logl += (nobs[ib] > 0.0 ? nobs[ib] * lg[ib] : 0.0) - nu[ib];
   return -2.0 * logl;
 }
 
-double Fitter::get_nll_min_free_mu_(const std::string &minimizer, const std::string &algo, bool verbose) {
-  std::unique_ptr<ROOT::Math::Minimizer> min{ROOT::Math::Factory::CreateMinimizer(minimizer.c_str(),
-                                                                                 algo.c_str())};
+Fitter::FitResult Fitter::minimise_(const Model &m, const std::vector<double> &x0, int fixed_index,
+                                    const std::string &minimizer, const std::string &algo, bool verbose,
+                                    bool hesse) {
+  static std::mutex factory_mutex;
+  std::unique_ptr<ROOT::Math::Minimizer> min;
+  {
+    std::lock_guard<std::mutex> lock(factory_mutex);
+    min.reset(ROOT::Math::Factory::CreateMinimizer(minimizer.c_str(), algo.c_str()));
+  }
+  if (!min) throw std::runtime_error("failed to create ROOT::Math::Minimizer");
+  const std::size_t n_pars = m.par_names.size();
   min->SetPrintLevel(verbose ? 1 : 0);
   min->SetStrategy(1);
   min->SetMaxFunctionCalls(100000);
   min->SetMaxIterations(100000);
   min->SetTolerance(1e-4);
-  ROOT::Math::Functor f(this, &Fitter::nll_, n_pars_);
+  ROOT::Math::Functor f([&m](const double *x) { return nll_(m, x); }, n_pars);
   min->SetFunction(f);
-  min->SetLimitedVariable(0, "mu", std::clamp(guess_mu_(), mu_lo_, mu_hi_), 0.1, mu_lo_, mu_hi_);
-  for (std::size_t i = 1; i < n_pars_; ++i)
-    min->SetVariable(static_cast<int>(i), par_names_[i].c_str(), 0.0, 0.1);
-  min->Minimize();
-  return min->MinValue() / 2.0;
+  const std::size_t n_poi = m.poi_lo.size();
+  for (std::size_t i = 0; i < n_poi; ++i)
+    min->SetLimitedVariable(static_cast<int>(i), m.par_names[i].c_str(), std::clamp(x0[i], m.poi_lo[i], m.poi_hi[i]),
+                            0.1, m.poi_lo[i], m.poi_hi[i]);
+  for (std::size_t i = n_poi; i < n_pars; ++i)
+    min->SetVariable(static_cast<int>(i), m.par_names[i].c_str(), x0[i], 0.1);
+  if (fixed_index >= 0) min->FixVariable(fixed_index);
+  bool ok = min->Minimize();
+  FitResult fr;
+  fr.status = min->Status();
+  fr.nll = min->MinValue() / 2.0;
+  fr.poi_names.assign(m.par_names.begin(), m.par_names.begin() + n_poi);
+  // FitResult::mu is the POI named "mu", the one set_mu_bounds() acts on; it stays
+  // NaN when "mu" has no signal processes and is not part of the layout.
+  const auto mu_it = std::find(fr.poi_names.begin(), fr.poi_names.end(), "mu");
+  const std::ptrdiff_t imu = mu_it == fr.poi_names.end() ? -1 : mu_it - fr.poi_names.begin();
+  const double *xs = min->X();
+  const double *xe = min->Errors();
+  if (ok && xs) {
+    if (imu >= 0) {
+      fr.mu = xs[imu];
+      fr.mu_err_sym = (xe ? xe[imu] : std::numeric_limits<double>::quiet_NaN());
+    }
+    for (std::size_t i = 0; i < n_poi; ++i) {
+      fr.poi_values[m.par_names[i]] = xs[i];
+      if (xe) fr.poi_errors[m.par_names[i]] = xe[i];
+    }
+    for (std::size_t i = n_poi; i < n_pars; ++i) {
+      fr.nuis_values[m.par_names[i]] = xs[i];
+      if (xe) fr.nuis_errors[m.par_names[i]] = xe[i];
+    }
+  }
+  if (hesse) {
+    min->Hesse();
+    if (const double *he = min->Errors()) {
+      if (imu >= 0) fr.mu_err_sym = he[imu];
+      for (std::size_t i = 0; i < n_poi; ++i) fr.poi_errors[m.par_names[i]] = he[i];
+      for (std::size_t i = n_poi; i < n_pars; ++i) fr.nuis_errors[m.par_names[i]] = he[i];
+    }
+    fr.poi_cov.resize(n_poi * n_poi);
+    for (std::size_t i = 0; i < n_poi; ++i)
+      for (std::size_t j = 0; j < n_poi; ++j)
+        fr.poi_cov[i * n_poi + j] = min->CovMatrix(static_cast<unsigned>(i), static_cast<unsigned>(j));
+  }
+  return fr;
 }
 
-} // namespace rarexsec::internal::fit
+double Fitter::get_nll_min_free_mu_(const std::string &minimizer, const std::string &algo, bool verbose) {
+  return minimise_(*model_, initial_pars_(*model_), -1, minimizer, algo, verbose, false).nll;
+}
 
+} // namespace rarexsec::internal::fit
@@ -4,6 +4,7 @@
 #include <cassert>
 #include <cmath>
 #include <cstddef>
+#include <cstdint>
 #include <functional>
 #include <limits>
 #include <map>
@@ -25,14 +26,34 @@ public:
   struct FitResult {
     int status = -1;
     double nll = std::numeric_limits<double>::quiet_NaN();
+    // The POI named "mu"; NaN, with its errors, when "mu" has no signal processes.
     double mu = std::numeric_limits<double>::quiet_NaN();
     double mu_err_sym = std::numeric_limits<double>::quiet_NaN();
     double mu_err_lo = std::numeric_limits<double>::quiet_NaN();
     double mu_err_hi = std::numeric_limits<double>::quiet_NaN();
+    std::vector<std::string> poi_names;
+    std::map<std::string, double> poi_values;
+    std::map<std::string, double> poi_errors;
+    std::vector<double> poi_cov;
     std::map<std::string, double> nuis_values;
     std::map<std::string, double> nuis_errors;
   };
 
+  struct Impact {
+    std::string name;
+    double theta = std::numeric_limits<double>::quiet_NaN();
+    double theta_err = std::numeric_limits<double>::quiet_NaN();
+    double prefit_up = std::numeric_limits<double>::quiet_NaN();
+    double prefit_down = std::numeric_limits<double>::quiet_NaN();
+    double postfit_up = std::numeric_limits<double>::quiet_NaN();
+    double postfit_down = std::numeric_limits<double>::quiet_NaN();
+    // Set when one of the four shifted refits did not converge; its shift is NaN.
+    bool failed = false;
+    double rank() const {
+      return failed ? std::numeric_limits<double>::quiet_NaN() : std::max(std::abs(postfit_up), std::abs(postfit_down));
+    }
+  };
+
   struct CPKey {
     std::string ch;
     std::string pr;
@@ -49,7 +70,17 @@ public:
   void set_sigma_ref(double sigma_ref_pb);
   double sigma_ref() const;
   void set_mu_bounds(double lo, double hi);
+  void add_poi(const std::string &name, double lo = 0.0, double hi = 10.0);
+  void set_poi_bounds(const std::string &name, double lo, double hi);
+  // Processes marked signal are scaled by "mu" unless a rule routes them elsewhere;
+  // rules are applied in order and the last match wins. An empty channel matches
+  // every channel. An empty process matches the signal processes only, while a
+  // named process is scaled by the POI even if it is not marked signal.
+  void assign_poi(const std::string &poi, const std::string &channel, const std::string &process);
+  std::vector<std::string> poi_names();
   void set_yield_floor(double eps);
+  void set_mc_stat(bool enabled, double threshold = 0.0);
+  void set_fast_log(bool enabled, double tolerance = 1e-10);
 
   void add_channel(const std::string &channel, const TH1 *h_data);
   void add_process(const std::string &channel, const std::string &process, const TH1 *h_nominal,
@@ -69,11 +100,20 @@ public:
   std::vector<std::pair<double, double>> scan_delta_nll(double mu_min, double mu_max, int npts,
                                                         const std::string &minimizer = "Minuit2",
                                                         const std::string &algo = "Migrad",
-                                                        bool verbose = false);
+                                                        bool verbose = false, const std::string &poi = "");
+
+  std::vector<Impact> impacts(const std::string &minimizer = "Minuit2", const std::string &algo = "Migrad",
+                              unsigned nthreads = 0, bool verbose = false, const std::string &poi = "");
 
   double cross_section_pb(const FitResult &fr) const;
   double cross_section_err_sym_pb(const FitResult &fr) const;
 
+  // A loaded model keeps its channels, processes, systematics and POI assignment;
+  // only POI bounds, the yield floor, the fast log and sigma_ref can still change.
+  // sigma_ref and the yield floor are saved with the model and restored on load.
+  void save_model(const std::string &path);
+  static Fitter load_model(const std::string &path);
+
 private:
   struct Process {
     std::string name;
@@ -94,6 +134,12 @@ private:
     Channel &operator=(const Channel &);
   };
 
+  struct Poi {
+    std::string name;
+    double lo = 0.0;
+    double hi = 10.0;
+  };
+
   struct NormNuisance {
     std::string name;
     bool log_normal = true;
@@ -110,16 +156,88 @@ private:
     ShapeNuisance &operator=(const ShapeNuisance &);
   };
 
+  template <class T>
+  struct Span {
+    const T *ptr = nullptr;
+    std::size_t n = 0;
+    const T &operator[](std::size_t i) const { return ptr[i]; }
+    std::size_t size() const { return n; }
+    bool empty() const { return n == 0; }
+  };
+
+  struct Model {
+    struct Bins {
+      std::int32_t bin0 = 0;
+      std::int32_t nbins = 0;
+      std::int32_t proc0 = 0;
+      std::int32_t proc1 = 0;
+    };
+    struct Proc {
+      std::int32_t yield0 = 0;
+      std::int32_t poi = -1;
+      std::int32_t norm0 = 0;
+      std::int32_t norm1 = 0;
+      std::int32_t shape0 = 0;
+      std::int32_t shape1 = 0;
+    };
+    struct NormTerm {
+      std::int32_t par = -1;
+      std::int32_t log_normal = 1;
+      double frac = 0.0;
+    };
+    struct ShapeTerm {
+      std::int32_t par = -1;
+      std::int32_t delta0 = 0;
+    };
+    Span<Bins> channels;
+    Span<Proc> procs;
+    Span<NormTerm> norms;
+    Span<ShapeTerm> shapes;
+    Span<double> data;
+    Span<double> yields;
+    Span<double> deltas;
+    Span<double> mc_rel_var;
+    Span<double> poi_bounds;
+    std::vector<std::string> par_names;
+    std::vector<double> poi_lo;
+    std::vector<double> poi_hi;
+    double eps = 1e-9;
+    int log_terms = 0;
+    const unsigned char *image = nullptr;
+    std::size_t image_bytes = 0;
+    std::shared_ptr<const void> storage;
+  };
+
+  struct ModelTables {
+    std::vector<Model::Bins> channels;
+    std::vector<Model::Proc> procs;
+    std::vector<Model::NormTerm> norms;
+    std::vector<Model::ShapeTerm> shapes;
+    std::vector<double> data;
+    std::vector<double> yields;
+    std::vector<double> deltas;
+    std::vector<double> mc_rel_var;
+    std::vector<double> poi_bounds;
+    std::vector<std::string> par_names;
+  };
+
   static TH1D *clone_as_th1d_(const TH1 *h, const std::string &new_name);
   static void ensure_same_binning_(const TH1 &a, const TH1 &b, const std::string &ctx);
 
   bool has_proc_(const std::string &ch, const std::string &pr) const;
-  bool has_any_signal_() const;
   void clear_();
-  void build_parameter_indexing_();
-  double guess_mu_() const;
-  double nll_(const double *x) const;
+  void ensure_mutable_(const char *what) const;
+  void build_parameter_indexing_(const std::vector<const Poi *> &pois);
+  void compile_();
+  static Model pack_model_(const ModelTables &t);
+  static Model view_model_(const unsigned char *image, std::size_t bytes, std::shared_ptr<const void> storage);
+  int poi_index_(const std::string &poi) const;
+  static std::vector<double> initial_pars_(const Model &m);
+  static double nll_(const Model &m, const double *x);
+  static FitResult minimise_(const Model &m, const std::vector<double> &x0, int fixed_index,
+                             const std::string &minimizer, const std::string &algo, bool verbose, bool hesse);
   double get_nll_min_free_mu_(const std::string &minimizer, const std::string &algo, bool verbose);
+  Poi *find_poi_(const std::string &name);
 
   std::map<std::string, Channel> channels_;
   std::set<std::string> all_channels_;
@@ -128,12 +246,16 @@ private:
   std::map<std::string, ShapeNuisance> shape_nuis_;
   std::string signal_label_;
   double sigma_ref_pb_ = 1.0;
-  double mu_lo_ = 0.0;
-  double mu_hi_ = 10.0;
+  std::vector<Poi> pois_{Poi{"mu", 0.0, 10.0}};
+  std::vector<std::pair<CPKey, std::string>> poi_rules_;
   double eps_ = 1e-9;
+  bool mc_stat_ = false;
+  double mc_stat_threshold_ = 0.0;
+  int log_terms_ = 0;
   std::size_t n_pars_ = 0;
   std::vector<std::string> par_names_;
   std::vector<int> par_is_norm_;
+  std::shared_ptr<const Model> model_;
 };
 
 } // namespace rarexsec::internal::fit
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace rarexsec::internal::fit::kernels {
+
+inline constexpr int kMaxLogTerms = 12;
+
+// log(x) = e*ln2 + 2*atanh(s), s = (m-1)/(m+1), m in [sqrt(1/2), sqrt(2)), so |s| <= 0.1716.
+// Truncating the atanh series after K odd terms leaves at most 2|s|^(2K+1) / ((2K+1)(1-s^2)).
+inline int log_terms_for_tolerance(double tol) {
+  const double s = 0.17157287525380990;
+  for (int k = 1; k < kMaxLogTerms; ++k) {
+    const double bound = 2.0 * std::pow(s, 2 * k + 1) / ((2 * k + 1) * (1.0 - s * s));
+    if (bound < tol) return k;
+  }
+  return kMaxLogTerms;
+}
+
+template <int K, int k = 0>
+inline double atanh_poly(double s2) {
+  if constexpr (k == K - 1)
+    return 1.0 / (2 * k + 1);
+  else
+    return 1.0 / (2 * k + 1) + s2 * atanh_poly<K, k + 1>(s2);
+}
+
+template <int K>
+inline void log_series(const double *x, double *out, std::size_t n) {
+  constexpr double ln2 = 0.69314718055994531;
+  constexpr double two52 = 4503599627370496.0;
+  constexpr std::uint64_t mant_mask = 0x000fffffffffffffULL;
+  constexpr std::uint64_t one_bits = 0x3ff0000000000000ULL;
+  constexpr std::uint64_t sqrt2_bits = 0x3ff6a09e667f3bcdULL;
+  constexpr std::uint64_t two52_bits = 0x4330000000000000ULL;
+  // Branch-free integer and double arithmetic only, so the loop vectorises even on
+  // baseline SSE2: m is the mantissa scaled into [1, 2) and halved above sqrt(2),
+  // and the exponent is converted exactly by planting it in the mantissa of 2^52.
+  // Results are bit-identical to the scalar form. x must be positive and normal,
+  // which the yield floor guarantees for the expected yields passed in here.
+#pragma omp simd
+  for (std::size_t i = 0; i < n; ++i) {
+    std::uint64_t bits;
+    std::memcpy(&bits, &x[i], sizeof(bits));
+    const std::uint64_t mbits = (bits & mant_mask) | one_bits;
+    const std::uint64_t big = (sqrt2_bits - mbits) >> 63;
+    const std::uint64_t hbits = mbits - (big << 52);
+    const std::uint64_t ebits = ((bits >> 52) + big) | two52_bits;
+    double m, eb;
+    std::memcpy(&m, &hbits, sizeof(m));
+    std::memcpy(&eb, &ebits, sizeof(eb));
+    const double e = eb - (two52 + 1023.0);
+    const double s = (m - 1.0) / (m + 1.0);
+    out[i] = 2.0 * s * atanh_poly<K>(s * s) + e * ln2;
+  }
+}
+
+inline void log_exact(const double *x, double *out, std::size_t n) {
+  for (std::size_t i = 0; i < n; ++i) out[i] = std::log(x[i]);
+}
+
+// Natural log of n strictly positive, normal doubles; terms <= 0 selects std::log.
+inline void log_n(const double *x, double *out, std::size_t n, int terms) {
+  switch (terms) {
+  case 1: return log_series<1>(x, out, n);
+  case 2: return log_series<2>(x, out, n);
+  case 3: return log_series<3>(x, out, n);
+  case 4: return log_series<4>(x, out, n);
+  case 5: return log_series<5>(x, out, n);
+  case 6: return log_series<6>(x, out, n);
+  case 7: return log_series<7>(x, out, n);
+  case 8: return log_series<8>(x, out, n);
+  case 9: return log_series<9>(x, out, n);
+  case 10: return log_series<10>(x, out, n);
+  case 11: return log_series<11>(x, out, n);
+  case 12: return log_series<12>(x, out, n);
+  default: return log_exact(x, out, n);
+  }
+}
+
+} // namespace rarexsec::internal::fit::kernels
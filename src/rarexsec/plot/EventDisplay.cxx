@@ -2,23 +2,39 @@
 
 #include <algorithm>
 #include <array>
-#include <atomic>
 #include <cmath>
+#include <condition_variable>
+#include <exception>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
 #include <mutex>
 #include <numeric>
+#include <set>
 #include <sstream>
+#include <stdexcept>
 #include <string>
 #include <system_error>
+#include <thread>
+#include <tuple>
+#include <type_traits>
 #include <utility>
 
 #include <ROOT/RConfig.h>
+#include <TROOT.h>
 #include <TStyle.h>
 #include <nlohmann/json.hpp>
 
+#include "rarexsec/Hub.h"
 #include "rarexsec/plot/Plotter.h"
+#include "rarexsec/plot/Raster.h"
+#include "rarexsec/proc/ColumnTrace.h"
+#include "rarexsec/proc/Expression.h"
+#include "rarexsec/proc/Memory.h"
+#include "rarexsec/proc/Profile.h"
 //____________________________________________________________________________
 rarexsec::plot::EventDisplay::EventDisplay(Spec spec, Options opt, DetectorData data)
     : spec_(std::move(spec)), opt_(std::move(opt)), data_(std::move(data)), plot_name_(rarexsec::plot::Plotter::sanitise(spec_.id)), output_directory_(opt_.out_dir) {}
@@ -26,6 +42,24 @@ rarexsec::plot::EventDisplay::EventDisplay(Spec spec, Options opt, DetectorData
 rarexsec::plot::EventDisplay::EventDisplay(Spec spec, Options opt, SemanticData data)
     : spec_(std::move(spec)), opt_(std::move(opt)), data_(std::move(data)), plot_name_(rarexsec::plot::Plotter::sanitise(spec_.id)), output_directory_(opt_.out_dir) {}
 //____________________________________________________________________________
+rarexsec::plot::EventDisplay::EventDisplay(Spec spec, Options opt, SparseDetectorData data)
+    : spec_(std::move(spec)), opt_(std::move(opt)), data_(std::move(data)), plot_name_(rarexsec::plot::Plotter::sanitise(spec_.id)), output_directory_(opt_.out_dir) {}
+//____________________________________________________________________________
+rarexsec::plot::EventDisplay::EventDisplay(Spec spec, Options opt, SparseSemanticData data)
+    : spec_(std::move(spec)), opt_(std::move(opt)), data_(std::move(data)), plot_name_(rarexsec::plot::Plotter::sanitise(spec_.id)), output_directory_(opt_.out_dir) {}
+//____________________________________________________________________________
+template <class T>
+static std::size_t flat_size(const std::vector<T>& v)
+{
+    return v.size();
+}
+//____________________________________________________________________________
+template <class T>
+static std::size_t flat_size(const rarexsec::sparse::Image<T>& v)
+{
+    return v.size;
+}
+//____________________________________________________________________________
 void rarexsec::plot::EventDisplay::draw(TCanvas& canvas) 
 {
     setup_canvas(canvas);
@@ -72,6 +106,68 @@ void rarexsec::plot::EventDisplay::draw_and_save(const std::string& image_format
     }
 }
 //____________________________________________________________________________
+void rarexsec::plot::EventDisplay::save_raster(const std::string& path) const
+{
+    const auto [W, H] = std::visit([&](auto const& vec) {
+        return deduce_grid(spec_.grid_w, spec_.grid_h, flat_size(vec));
+    },
+                                   data_);
+    raster::write_png(rasterise(1, raster::Pooling::Max, std::max(1, opt_.canvas_size / std::max(W, H))), path);
+}
+//____________________________________________________________________________
+rarexsec::plot::raster::Image rarexsec::plot::EventDisplay::rasterise(int factor, raster::Pooling pooling,
+                                                                      int scale) const
+{
+    const auto grid = std::visit([&](auto const& vec) {
+        return deduce_grid(spec_.grid_w, spec_.grid_h, flat_size(vec));
+    },
+                                 data_);
+    const int W = grid.first;
+    const int H = grid.second;
+    return std::visit([&](const auto& v) {
+        using Data = std::decay_t<decltype(v)>;
+        if constexpr (std::is_same_v<Data, DetectorData> || std::is_same_v<Data, SparseDetectorData>) {
+            if (factor <= 1)
+                return raster::detector(v, W, H, opt_.det_threshold, opt_.det_min, opt_.det_max, opt_.use_log_z, scale);
+            const auto g = raster::pool(v, W, H, factor, pooling);
+            // A summed block covers factor^2 wires x ticks, so the colour scale grows with it.
+            const double z = pooling == raster::Pooling::Sum ? static_cast<double>(factor) * factor : 1.0;
+            return raster::detector(g.values, g.width, g.height, opt_.det_threshold, z * opt_.det_min,
+                                    z * opt_.det_max, opt_.use_log_z, scale);
+        } else {
+            if (factor <= 1)
+                return raster::semantic(v, W, H, scale);
+            const auto g = raster::pool(v, W, H, factor);
+            return raster::semantic(g.values, g.width, g.height, scale);
+        }
+    },
+                      data_);
+}
+//____________________________________________________________________________
+rarexsec::plot::EventDisplay::SparseDetectorData
+rarexsec::plot::EventDisplay::to_sparse(const DetectorData& data, double threshold)
+{
+    return sparse::encode(data, static_cast<float>(threshold));
+}
+//____________________________________________________________________________
+rarexsec::plot::EventDisplay::SparseSemanticData
+rarexsec::plot::EventDisplay::to_sparse(const SemanticData& data)
+{
+    return sparse::encode(data, 0);
+}
+//____________________________________________________________________________
+rarexsec::plot::EventDisplay::DetectorData
+rarexsec::plot::EventDisplay::to_dense(const SparseDetectorData& data)
+{
+    return sparse::decode<float, DetectorData>(data.index, data.value, data.size);
+}
+//____________________________________________________________________________
+rarexsec::plot::EventDisplay::SemanticData
+rarexsec::plot::EventDisplay::to_dense(const SparseSemanticData& data)
+{
+    return sparse::decode<int, SemanticData>(data.index, data.value, data.size);
+}
+//____________________________________________________________________________
 void rarexsec::plot::EventDisplay::setup_canvas(TCanvas& c) const 
 {
     c.SetCanvasSize(opt_.canvas_size, opt_.canvas_size);
@@ -115,7 +211,7 @@ void rarexsec::plot::EventDisplay::build_histogram()
 {
     const int bin_offset = 1;
     const auto [W, H] = std::visit([&](auto const& vec) {
-        return deduce_grid(spec_.grid_w, spec_.grid_h, vec.size());
+        return deduce_grid(spec_.grid_w, spec_.grid_h, flat_size(vec));
     },
                                    data_);
 
@@ -137,6 +233,26 @@ void rarexsec::plot::EventDisplay::build_histogram()
                 hist_->SetBinContent(c + bin_offset, r + bin_offset, y);
             }
         }
+    } else if (std::holds_alternative<SparseDetectorData>(data_)) {
+        const auto& v = std::get<SparseDetectorData>(data_);
+        const long long n = std::min<long long>(v.size, static_cast<long long>(W) * H);
+        for (int r = 0; r < H && r * W < n; ++r) {
+            for (int c = 0; c < W && r * W + c < n; ++c)
+                hist_->SetBinContent(c + bin_offset, r + bin_offset, opt_.det_min);
+        }
+        for (std::size_t i = 0; i < std::min(v.index.size(), v.value.size()); ++i) {
+            const int idx = static_cast<int>(v.index[i]);
+            if (v.index[i] < n && v.value[i] > opt_.det_threshold)
+                hist_->SetBinContent(idx % W + bin_offset, idx / W + bin_offset, v.value[i]);
+        }
+    } else if (std::holds_alternative<SparseSemanticData>(data_)) {
+        const auto& v = std::get<SparseSemanticData>(data_);
+        const long long n = std::min<long long>(v.size, static_cast<long long>(W) * H);
+        for (std::size_t i = 0; i < std::min(v.index.size(), v.value.size()); ++i) {
+            const int idx = static_cast<int>(v.index[i]);
+            if (v.index[i] < n)
+                hist_->SetBinContent(idx % W + bin_offset, idx / W + bin_offset, v.value[i]);
+        }
     } else {
         const auto& v = std::get<SemanticData>(data_);
         const int n = static_cast<int>(v.size());
@@ -242,6 +358,11 @@ void rarexsec::plot::EventDisplay::draw_semantic_legend()
             if (v >= 0 && v < palette_size)
                 counts[static_cast<std::size_t>(v)]++;
         }
+    } else if (std::holds_alternative<SparseSemanticData>(data_)) {
+        for (int v : std::get<SparseSemanticData>(data_).value) {
+            if (v >= 0 && v < palette_size)
+                counts[static_cast<std::size_t>(v)]++;
+        }
     }
 
     std::vector<int> order(palette_size - 1);
@@ -326,172 +447,413 @@ static std::string format_tag(std::string pattern, const std::string& plane, int
     return pattern;
 }
 //____________________________________________________________________________
+static std::string html_escape(const std::string& s)
+{
+    std::string out;
+    out.reserve(s.size());
+    for (char c : s) {
+        switch (c) {
+        case '&':
+            out += "&amp;";
+            break;
+        case '<':
+            out += "&lt;";
+            break;
+        case '>':
+            out += "&gt;";
+            break;
+        case '"':
+            out += "&quot;";
+            break;
+        default:
+            out += c;
+        }
+    }
+    return out;
+}
+//____________________________________________________________________________
+static std::filesystem::path absolute_dir(const std::filesystem::path& dir)
+{
+    auto p = std::filesystem::absolute(dir.empty() ? std::filesystem::path(".") : dir).lexically_normal();
+    return p.has_filename() ? p : p.parent_path();
+}
+//____________________________________________________________________________
+// Manifest paths are relative to `root`, the directory holding the manifest
+// (out_dir when none is written), unless they are absolute.
+static void write_index(const nlohmann::json& manifest, const std::string& html_path, const std::filesystem::path& root)
+{
+    const auto base = absolute_dir(std::filesystem::path(html_path).parent_path());
+    auto link = [&](const std::string& file) {
+        const std::filesystem::path p(file);
+        const auto target = p.is_absolute() ? p.lexically_normal() : (root / p).lexically_normal();
+        return html_escape(target.lexically_relative(base).generic_string());
+    };
+    std::ofstream out(html_path, std::ios::trunc);
+    if (!out)
+        throw std::runtime_error("EventDisplay: cannot write " + html_path);
+    out << "<!DOCTYPE html>\n<html><head><meta charset=\"utf-8\"><title>Event displays</title>\n"
+        << "<style>body{font-family:sans-serif}figure{display:inline-block;margin:4px;text-align:center}"
+        << "img{width:200px;image-rendering:pixelated}</style></head><body>\n";
+    for (const auto& item : manifest) {
+        const auto file = item.value("file", std::string{});
+        const auto thumb = item.value("thumbnail", std::string{});
+        const auto caption = std::to_string(item.value("run", 0)) + ":" + std::to_string(item.value("sub", 0)) + ":" +
+                             std::to_string(item.value("evt", 0)) + " " + item.value("plane", std::string{});
+        const bool png = std::filesystem::path(file).extension() == ".png";
+        out << "<figure><a href=\"" << link(file) << "\">";
+        if (!thumb.empty() || png)
+            out << "<img loading=\"lazy\" src=\"" << link(thumb.empty() ? file : thumb) << "\" alt=\"" << html_escape(caption) << "\">";
+        else
+            out << html_escape(caption);
+        out << "</a><figcaption>" << html_escape(caption);
+        if (item.contains("tiles"))
+            out << " <a href=\"" << link(item.at("tiles").get<std::string>()) << "\">tiles</a>";
+        out << "</figcaption></figure>\n";
+    }
+    out << "</body></html>\n";
+}
+//____________________________________________________________________________
+// Planes the snapshot stored only as (index, value, size) are read back as
+// sparse images under `name` and rendered without rebuilding the dense grid.
+template <class T>
+static ROOT::RDF::RNode sparse_plane(ROOT::RDF::RNode node, const std::string& col, const std::string& name)
+{
+    const std::vector<std::string> parts{rarexsec::sparse::index_column(col), rarexsec::sparse::value_column(col),
+                                         rarexsec::sparse::size_column(col)};
+    rarexsec::trace::use(parts);
+    return node.Define(name, [](const ROOT::RVec<unsigned int>& i, const ROOT::RVec<T>& v, unsigned int n) {
+        return rarexsec::sparse::Image<T>{i, v, n};
+    },
+                       parts);
+}
+//____________________________________________________________________________
+// Without implicit MT these are the first n_events entries in file order. With IMT
+// entry order is not defined, so an extra Take pass picks the n_events smallest
+// distinct (run, sub, evt) ids instead; each id is passed once even if repeated.
+// The picked ids are returned in ascending order (empty without IMT, where the
+// loop already delivers entries in order) so callers can restore a fixed order.
+using EventId = std::array<int, 3>;
+
+struct FirstEvents {
+    ROOT::RDF::RNode node;
+    std::vector<EventId> order;
+};
+
+static FirstEvents first_events(ROOT::RDF::RNode node, const rarexsec::plot::EventDisplay::BatchOptions& opt)
+{
+    if (!ROOT::IsImplicitMTEnabled())
+        return {node.Range(static_cast<ULong64_t>(opt.n_events)), {}};
+
+    auto ids = node.Define("_ed_id", [](int run, int sub, int evt) { return EventId{run, sub, evt}; },
+                           {opt.cols.run, opt.cols.sub, opt.cols.evt})
+                   .Take<EventId>("_ed_id");
+    std::vector<EventId> sorted = *ids;
+    std::sort(sorted.begin(), sorted.end());
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+    if (sorted.size() > opt.n_events)
+        sorted.resize(static_cast<std::size_t>(opt.n_events));
+
+    struct Pending {
+        std::mutex mutex;
+        std::set<EventId> ids;
+    };
+    auto pending = std::make_shared<Pending>();
+    pending->ids.insert(sorted.begin(), sorted.end());
+    auto limited = node.Filter([pending](int run, int sub, int evt) {
+        std::lock_guard<std::mutex> lock(pending->mutex);
+        return pending->ids.erase(EventId{run, sub, evt}) > 0;
+    },
+                               {opt.cols.run, opt.cols.sub, opt.cols.evt});
+    return {limited, std::move(sorted)};
+}
+//____________________________________________________________________________
+void rarexsec::plot::EventDisplay::render_events(const Entry& rec, const std::vector<events::Key>& keys,
+                                                 const std::string& index_path, BatchOptions opt)
+{
+    const auto idx = Hub::event_index(rec, index_path, {opt.cols.run, opt.cols.sub, opt.cols.evt});
+    const auto found = idx.locate(keys);
+    if (!found.missing.empty() || !found.duplicated.empty())
+        std::cerr << "[EventDisplay] " << found.missing.size() << " requested events not found and "
+                  << found.duplicated.size() << " found more than once in " << profile::label(rec) << '\n';
+    const auto frame = Hub::sample(rec, idx, found);
+    opt.n_events = found.found.size();
+    render_from_rdf(frame.rnode(), opt);
+}
+//____________________________________________________________________________
 void rarexsec::plot::EventDisplay::render_from_rdf(ROOT::RDF::RNode df, const BatchOptions& opt) 
 {
+    if (opt.backend == Backend::Raster && (opt.image_format != "png" || !opt.combined_pdf.empty()))
+        throw std::invalid_argument("EventDisplay: raster backend only writes individual png images");
+    profile::Scope scope("event_display:" + opt.out_dir);
+    memory::Stage stage("event_display:" + opt.out_dir);
+
     std::error_code ec;
     std::filesystem::create_directories(opt.out_dir, ec);
     if (ec) {
         std::cerr << "[EventDisplay] Failed to create output directory '"
                   << opt.out_dir << "': " << ec.message() << '\n';
     }
+    if (opt.thumbnail_factor > 1)
+        std::filesystem::create_directories(std::filesystem::path(opt.out_dir) / "thumbs");
 
     auto filtered = df;
-    if (!opt.selection_expr.empty())
-        filtered = filtered.Filter(opt.selection_expr);
-
-    auto limited = filtered.Range(static_cast<ULong64_t>(opt.n_events));
-
-    const bool use_combined_pdf = (!opt.combined_pdf.empty() && opt.image_format == "pdf");
-    std::filesystem::path combined_path;
-    std::size_t total_pages = 0;
-    if (use_combined_pdf) {
-        combined_path = std::filesystem::path(opt.out_dir) / opt.combined_pdf;
-        const auto n_rows = static_cast<std::size_t>(limited.Count().GetValue());
-        if (n_rows == 0) {
-            std::cerr << "[EventDisplay] No rows matched selection; nothing to render." << '\n';
-            return;
+    const std::vector<std::string> image_cols = opt.mode == Mode::Detector
+                                                    ? std::vector<std::string>{opt.cols.det_u, opt.cols.det_v, opt.cols.det_w}
+                                                    : std::vector<std::string>{opt.cols.sem_u, opt.cols.sem_v, opt.cols.sem_w};
+    const bool sparse_input = std::all_of(image_cols.begin(), image_cols.end(), [&](const std::string& col) {
+        return !filtered.HasColumn(col) && filtered.HasColumn(sparse::index_column(col));
+    });
+    std::vector<std::string> cols{opt.cols.run, opt.cols.sub, opt.cols.evt};
+    for (const auto& col : image_cols) {
+        if (!sparse_input) {
+            cols.push_back(col);
+            continue;
         }
-        total_pages = n_rows * opt.planes.size();
-
-#if defined(R__HAS_IMPLICITMT)
-        if (ROOT::IsImplicitMTEnabled()) {
-            ROOT::DisableImplicitMT();
-            std::clog << "[EventDisplay] Implicit MT disabled for stable combined PDF output." << '\n';
-        }
-#else
-        if (ROOT::IsImplicitMTEnabled()) {
-            ROOT::DisableImplicitMT();
-            std::clog << "[EventDisplay] ROOT built without R__HAS_IMPLICITMT; disabling MT for combined PDF." << '\n';
-        }
-#endif
+        cols.push_back("_ed_sparse_" + col);
+        filtered = opt.mode == Mode::Detector ? sparse_plane<float>(filtered, col, cols.back())
+                                              : sparse_plane<int>(filtered, col, cols.back());
     }
+    if (!opt.selection_expr.empty())
+        filtered = expr::filter(filtered, opt.selection_expr);
 
-    using nlohmann::json;
-    json manifest = json::array();
-    std::mutex manifest_mutex;
+    const bool use_combined_pdf = (!opt.combined_pdf.empty() && opt.image_format == "pdf");
+    const bool render_inline = opt.backend == Backend::Raster;
+    const auto combined_path = std::filesystem::path(opt.out_dir) / opt.combined_pdf;
 
     auto display_opts = opt.display;
     display_opts.out_dir = opt.out_dir;
 
-    if (opt.mode == Mode::Detector) {
-        const std::vector<std::string> cols{
-            opt.cols.run, opt.cols.sub, opt.cols.evt,
-            opt.cols.det_u, opt.cols.det_v, opt.cols.det_w};
-
-        std::atomic<std::size_t> page_idx{0};
-        limited.Foreach(
-            [&](int run, int sub, int evt,
-                const std::vector<float>& det_u,
-                const std::vector<float>& det_v,
-                const std::vector<float>& det_w) {
-                auto pick = [&](const std::string& plane) -> const std::vector<float>& {
-                    if (plane == "U")
-                        return det_u;
-                    else if (plane == "V")
-                        return det_v;
-                    else
-                        return det_w;
-                };
-
-                for (const auto& plane : opt.planes) {
-                    const auto& img = pick(plane);
-                    const std::string tag = format_tag(opt.file_pattern, plane, run, sub, evt);
-                    const std::string title =
-                        "Detector Image, Plane " + plane +
-                        " - Run " + std::to_string(run) +
-                        ", Subrun " + std::to_string(sub) +
-                        ", Event " + std::to_string(evt);
-
-                    rarexsec::plot::EventDisplay::Spec spec{tag, title, Mode::Detector};
-                    EventDisplay ed(spec, display_opts, img);
-
-                    if (use_combined_pdf) {
-                        const std::size_t idx = page_idx++;
-                        std::string target = combined_path.string();
-                        if (idx == 0)
-                            target += "(";
-                        else if (idx + 1 == total_pages)
-                            target += ")";
-                        ed.draw_and_save("pdf", target);
-                        if (!opt.manifest_path.empty()) {
-                            std::lock_guard<std::mutex> lock(manifest_mutex);
-                            manifest.push_back({{"run", run}, {"sub", sub}, {"evt", evt}, {"plane", plane}, {"file", combined_path.string()}});
-                        }
-                    } else {
-                        ed.draw_and_save(opt.image_format);
-                        if (!opt.manifest_path.empty()) {
-                            const std::string file = (std::filesystem::path(opt.out_dir) /
-                                                      (rarexsec::plot::Plotter::sanitise(tag) + "." + opt.image_format))
-                                                         .string();
-                            std::lock_guard<std::mutex> lock(manifest_mutex);
-                            manifest.push_back({{"run", run}, {"sub", sub}, {"evt", evt}, {"plane", plane}, {"file", file}});
-                        }
+    auto first = first_events(filtered, opt);
+    auto& limited = first.node;
+    const unsigned nslots = limited.GetNSlots();
+
+    struct Row {
+        int run, sub, evt;
+        std::size_t plane;
+        std::string file;
+        std::string thumbnail;
+        std::string tiles;
+    };
+    auto row_less = [](const auto& a, const auto& b) {
+        return std::tie(a.run, a.sub, a.evt, a.plane) < std::tie(b.run, b.sub, b.evt, b.plane);
+    };
+    std::vector<std::vector<Row>> slot_rows(nslots);
+
+    auto run_batch = [&](auto proto, Mode mode, const char* label, const std::vector<std::string>& cols) {
+        using Data = decltype(proto);
+        struct Page {
+            int run, sub, evt;
+            std::size_t plane;
+            Data img;
+        };
+
+        auto make_display = [&](const Page& p) {
+            const auto& plane = opt.planes[p.plane];
+            const std::string tag = format_tag(opt.file_pattern, plane, p.run, p.sub, p.evt);
+            const std::string title = std::string(label) + ", Plane " + plane +
+                                      " - Run " + std::to_string(p.run) +
+                                      ", Subrun " + std::to_string(p.sub) +
+                                      ", Event " + std::to_string(p.evt);
+            return EventDisplay(Spec{tag, title, mode}, display_opts, p.img);
+        };
+        auto image_file = [&](const Page& p) {
+            const auto tag = format_tag(opt.file_pattern, opt.planes[p.plane], p.run, p.sub, p.evt);
+            return (std::filesystem::path(opt.out_dir) /
+                    (rarexsec::plot::Plotter::sanitise(tag) + "." + opt.image_format))
+                .string();
+        };
+
+        auto add_row = [&](std::vector<Row>& rows, const Page& p, const EventDisplay& ed, std::string file) {
+            Row row{p.run, p.sub, p.evt, p.plane, std::move(file), {}, {}};
+            const auto stem = rarexsec::plot::Plotter::sanitise(
+                format_tag(opt.file_pattern, opt.planes[p.plane], p.run, p.sub, p.evt));
+            if (opt.thumbnail_factor > 1) {
+                row.thumbnail = (std::filesystem::path(opt.out_dir) / "thumbs" / (stem + ".png")).string();
+                raster::write_png(ed.rasterise(opt.thumbnail_factor, opt.thumbnail_pooling), row.thumbnail);
+            }
+            if (opt.tile_levels > 0) {
+                const auto dir = std::filesystem::path(opt.out_dir) / "tiles" / stem;
+                for (int level = 0; level < opt.tile_levels; ++level)
+                    raster::write_tiles(ed.rasterise(1 << level, opt.thumbnail_pooling), opt.tile_size,
+                                        (dir / std::to_string(level)).string());
+                row.tiles = dir.string();
+            }
+            rows.push_back(std::move(row));
+        };
+
+        // Sparse planes are traced by sparse_plane under their stored names.
+        trace::use(sparse_input ? std::vector<std::string>{opt.cols.run, opt.cols.sub, opt.cols.evt} : cols);
+        if (render_inline) {
+            limited.ForeachSlot(
+                [&](unsigned slot, int run, int sub, int evt, const Data& u, const Data& v, const Data& w) {
+                    for (std::size_t ip = 0; ip < opt.planes.size(); ++ip) {
+                        const auto& plane = opt.planes[ip];
+                        Page page{run, sub, evt, ip, plane == "U" ? u : (plane == "V" ? v : w)};
+                        const auto file = image_file(page);
+                        const auto ed = make_display(page);
+                        ed.save_raster(file);
+                        add_row(slot_rows[slot], page, ed, file);
                     }
-                }
-            },
-            cols);
-    } else {
-        const std::vector<std::string> cols{
-            opt.cols.run, opt.cols.sub, opt.cols.evt,
-            opt.cols.sem_u, opt.cols.sem_v, opt.cols.sem_w};
-
-        std::atomic<std::size_t> page_idx{0};
-        limited.Foreach(
-            [&](int run, int sub, int evt,
-                const std::vector<int>& sem_u,
-                const std::vector<int>& sem_v,
-                const std::vector<int>& sem_w) {
-                auto pick = [&](const std::string& plane) -> const std::vector<int>& {
-                    if (plane == "U")
-                        return sem_u;
-                    else if (plane == "V")
-                        return sem_v;
-                    else
-                        return sem_w;
-                };
-
-                for (const auto& plane : opt.planes) {
-                    const auto& img = pick(plane);
-                    const std::string tag = format_tag(opt.file_pattern, plane, run, sub, evt);
-                    const std::string title =
-                        "Semantic Image, Plane " + plane +
-                        " - Run " + std::to_string(run) +
-                        ", Subrun " + std::to_string(sub) +
-                        ", Event " + std::to_string(evt);
-
-                    rarexsec::plot::EventDisplay::Spec spec{tag, title, Mode::Semantic};
-                    EventDisplay ed(spec, display_opts, img);
-
-                    if (use_combined_pdf) {
-                        const std::size_t idx = page_idx++;
-                        std::string target = combined_path.string();
-                        if (idx == 0)
-                            target += "(";
-                        else if (idx + 1 == total_pages)
-                            target += ")";
-                        ed.draw_and_save("pdf", target);
-                        if (!opt.manifest_path.empty()) {
-                            std::lock_guard<std::mutex> lock(manifest_mutex);
-                            manifest.push_back({{"run", run}, {"sub", sub}, {"evt", evt}, {"plane", plane}, {"file", combined_path.string()}});
-                        }
-                    } else {
-                        ed.draw_and_save(opt.image_format);
-                        if (!opt.manifest_path.empty()) {
-                            const std::string file = (std::filesystem::path(opt.out_dir) /
-                                                      (rarexsec::plot::Plotter::sanitise(tag) + "." + opt.image_format))
-                                                         .string();
-                            std::lock_guard<std::mutex> lock(manifest_mutex);
-                            manifest.push_back({{"run", run}, {"sub", sub}, {"evt", evt}, {"plane", plane}, {"file", file}});
+                },
+                cols);
+            return;
+        }
+
+        // Canvases are drawn on this thread only, so the event loop runs on a worker
+        // and the slots hand over finished displays (thumbnails and tiles already
+        // rasterised) keyed by a sequence number. Separate image files are drawn as
+        // they come, with at most a few pages per slot waiting. Pages of the combined
+        // PDF are drawn in (run, sub, evt, plane) order: under IMT a page waits until
+        // all earlier ones have been drawn, so slots never block on this buffer and it
+        // holds at most n_events * planes pages.
+        const std::size_t nplanes = opt.planes.size();
+        struct Queue {
+            std::mutex mutex;
+            std::condition_variable cv;
+            std::map<std::size_t, EventDisplay> pages;
+            std::size_t next = 0;
+            std::size_t arrived = 0;
+            std::size_t capacity = 0;
+            bool done = false;
+            bool stop = false;
+        } queue;
+        queue.capacity = 2 * std::max(1u, nslots) * std::max<std::size_t>(1, nplanes);
+        const auto& order = first.order;
+
+        ROOT::EnableThreadSafety();
+        std::exception_ptr loop_error;
+        std::thread loop([&] {
+            try {
+                limited.ForeachSlot(
+                    [&](unsigned slot, int run, int sub, int evt, const Data& u, const Data& v, const Data& w) {
+                        const auto rank = static_cast<std::size_t>(
+                            std::lower_bound(order.begin(), order.end(), EventId{run, sub, evt}) - order.begin());
+                        for (std::size_t ip = 0; ip < nplanes; ++ip) {
+                            const auto& plane = opt.planes[ip];
+                            Page page{run, sub, evt, ip, plane == "U" ? u : (plane == "V" ? v : w)};
+                            auto ed = make_display(page);
+                            add_row(slot_rows[slot], page, ed, use_combined_pdf ? combined_path.string() : image_file(page));
+                            std::unique_lock<std::mutex> lock(queue.mutex);
+                            if (!use_combined_pdf)
+                                queue.cv.wait(lock, [&] { return queue.stop || queue.pages.size() < queue.capacity; });
+                            if (queue.stop)
+                                return;
+                            const auto seq = use_combined_pdf && !order.empty() ? rank * nplanes + ip : queue.arrived;
+                            ++queue.arrived;
+                            queue.pages.emplace(seq, std::move(ed));
+                            queue.cv.notify_all();
                         }
+                    },
+                    cols);
+            } catch (...) {
+                loop_error = std::current_exception();
+            }
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.done = true;
+            queue.cv.notify_all();
+        });
+
+        std::exception_ptr draw_error;
+        bool opened = false;
+        for (;;) {
+            std::unique_lock<std::mutex> lock(queue.mutex);
+            queue.cv.wait(lock, [&] {
+                return queue.done ||
+                       (!queue.pages.empty() && (!use_combined_pdf || queue.pages.begin()->first == queue.next));
+            });
+            if (queue.pages.empty())
+                break;
+            auto entry = queue.pages.extract(queue.pages.begin());
+            queue.next = entry.key() + 1;
+            queue.cv.notify_all();
+            lock.unlock();
+            try {
+                auto& ed = entry.mapped();
+                if (use_combined_pdf) {
+                    if (!opened) {
+                        TCanvas blank;
+                        blank.Print((combined_path.string() + "[").c_str());
+                        opened = true;
                     }
+                    ed.draw_and_save("pdf", combined_path.string());
+                } else {
+                    ed.draw_and_save(opt.image_format);
                 }
-            },
-            cols);
+            } catch (...) {
+                draw_error = std::current_exception();
+                lock.lock();
+                queue.stop = true;
+                queue.pages.clear();
+                queue.cv.notify_all();
+                break;
+            }
+        }
+        loop.join();
+        if (opened) {
+            TCanvas blank;
+            blank.Print((combined_path.string() + "]").c_str());
+        }
+        if (draw_error)
+            std::rethrow_exception(draw_error);
+        if (loop_error)
+            std::rethrow_exception(loop_error);
+        if (use_combined_pdf && !opened)
+            std::cerr << "[EventDisplay] No rows matched selection; nothing to render." << '\n';
+    };
+
+    if (opt.mode == Mode::Detector) {
+        if (sparse_input)
+            run_batch(SparseDetectorData{}, Mode::Detector, "Detector Image", cols);
+        else
+            run_batch(DetectorData{}, Mode::Detector, "Detector Image", cols);
+    } else {
+        if (sparse_input)
+            run_batch(SparseSemanticData{}, Mode::Semantic, "Semantic Image", cols);
+        else
+            run_batch(SemanticData{}, Mode::Semantic, "Semantic Image", cols);
+    }
+
+    std::vector<Row> rows;
+    for (auto& sr : slot_rows)
+        std::move(sr.begin(), sr.end(), std::back_inserter(rows));
+    std::sort(rows.begin(), rows.end(), row_less);
+
+    const auto root = absolute_dir(opt.manifest_path.empty() ? std::filesystem::path(opt.out_dir)
+                                                             : std::filesystem::path(opt.manifest_path).parent_path());
+    auto relative = [&](const std::string& path) {
+        return std::filesystem::absolute(path).lexically_normal().lexically_relative(root).generic_string();
+    };
+    nlohmann::json manifest = nlohmann::json::array();
+    for (const auto& r : rows) {
+        nlohmann::json item{{"run", r.run}, {"sub", r.sub}, {"evt", r.evt}, {"plane", opt.planes[r.plane]}, {"file", relative(r.file)}};
+        if (!r.thumbnail.empty())
+            item["thumbnail"] = relative(r.thumbnail);
+        if (!r.tiles.empty()) {
+            item["tiles"] = relative(r.tiles);
+            item["tile_levels"] = opt.tile_levels;
+            item["tile_size"] = opt.tile_size;
+        }
+        manifest.push_back(std::move(item));
     }
     if (!opt.manifest_path.empty()) {
         std::ofstream ofs(opt.manifest_path);
         ofs << manifest.dump(2);
         std::clog << "[EventDisplay] Wrote event display manifest: " << opt.manifest_path << '\n';
     }
+    if (!opt.html_index.empty()) {
+        const auto html = (std::filesystem::path(opt.out_dir) / opt.html_index).string();
+        write_index(manifest, html, root);
+        std::clog << "[EventDisplay] Wrote event display index: " << html << '\n';
+    }
+}
+//____________________________________________________________________________
+void rarexsec::plot::EventDisplay::write_html_index(const std::string& manifest_path, const std::string& html_path)
+{
+    std::ifstream in(manifest_path);
+    if (!in)
+        throw std::runtime_error("EventDisplay: cannot open manifest " + manifest_path);
+    nlohmann::json manifest;
+    in >> manifest;
+    write_index(manifest, html_path, absolute_dir(std::filesystem::path(manifest_path).parent_path()));
 }
 //____________________________________________________________________________
@@ -17,6 +17,11 @@
 
 #include <ROOT/RDataFrame.hxx>
 
+#include "rarexsec/plot/Raster.h"
+#include "rarexsec/proc/DataModel.h"
+#include "rarexsec/proc/EventIndex.h"
+#include "rarexsec/proc/SparseImage.h"
+
 namespace rarexsec {
 namespace plot {
 
@@ -29,6 +34,9 @@ class EventDisplay {
     enum class Mode { Detector,
                       Semantic };
 
+    enum class Backend { Canvas,
+                         Raster };
+
     static Mode parse_mode(const std::string& s) {
         if (s == "semantic" || s == "Semantic")
             return Mode::Semantic;
@@ -59,12 +67,22 @@ class EventDisplay {
 
     using DetectorData = std::vector<float>;
     using SemanticData = std::vector<int>;
+    using SparseDetectorData = sparse::Image<float>;
+    using SparseSemanticData = sparse::Image<int>;
+
+    static SparseDetectorData to_sparse(const DetectorData& data, double threshold);
+    static SparseSemanticData to_sparse(const SemanticData& data);
+    static DetectorData to_dense(const SparseDetectorData& data);
+    static SemanticData to_dense(const SparseSemanticData& data);
 
     void draw(TCanvas& canvas);
 
     void draw_and_save(const std::string& image_format = "png");
     void draw_and_save(const std::string& image_format, const std::string& file_override);
 
+    void save_raster(const std::string& path) const;
+    raster::Image rasterise(int factor = 1, raster::Pooling pooling = raster::Pooling::Max, int scale = 1) const;
+
     struct BatchOptions {
         std::string selection_expr;
         unsigned long long n_events{1};
@@ -91,14 +109,26 @@ class EventDisplay {
         std::string file_pattern{"{plane}_{run}_{sub}_{evt}"};
 
         Mode mode{Mode::Detector};
+        Backend backend{Backend::Canvas};
         Options display;
+
+        int thumbnail_factor{0};
+        raster::Pooling thumbnail_pooling{raster::Pooling::Max};
+        int tile_levels{0};
+        int tile_size{256};
+        std::string html_index;
     };
 
     static void render_from_rdf(ROOT::RDF::RNode df, const BatchOptions& opt);
+    static void render_events(const Entry& rec, const std::vector<events::Key>& keys,
+                              const std::string& index_path, BatchOptions opt);
+    static void write_html_index(const std::string& manifest_path, const std::string& html_path);
 
   private:
     EventDisplay(Spec spec, Options opt, DetectorData data);
     EventDisplay(Spec spec, Options opt, SemanticData data);
+    EventDisplay(Spec spec, Options opt, SparseDetectorData data);
+    EventDisplay(Spec spec, Options opt, SparseSemanticData data);
 
     void setup_canvas(TCanvas& c) const;
     void build_histogram();
@@ -115,7 +145,7 @@ class EventDisplay {
     Spec spec_;
     Options opt_;
 
-    std::variant<DetectorData, SemanticData> data_;
+    std::variant<DetectorData, SemanticData, SparseDetectorData, SparseSemanticData> data_;
 
     std::unique_ptr<TH2F> hist_;
     std::unique_ptr<TLegend> legend_;
@@ -0,0 +1,372 @@
+#include "rarexsec/plot/Raster.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+#include <zlib.h>
+
+//____________________________________________________________________________
+const std::array<rarexsec::plot::raster::Colour, rarexsec::plot::raster::semantic_palette_size>&
+rarexsec::plot::raster::semantic_palette()
+{
+    static const std::array<Colour, semantic_palette_size> palette{{
+        {230, 230, 230},
+        {0x66, 0x66, 0x66},
+        {0xe4, 0x1a, 0x1c},
+        {0x37, 0x7e, 0xb8},
+        {0x4d, 0xaf, 0x4a},
+        {0xff, 0x7f, 0x00},
+        {0x98, 0x4e, 0xa3},
+        {0xff, 0xff, 0x33},
+        {0x1b, 0x9e, 0x77},
+        {0xf7, 0x81, 0xbf},
+        {0xa6, 0x56, 0x28},
+        {0x66, 0xa6, 0x1e},
+        {0xe6, 0xab, 0x02},
+        {0xa6, 0xce, 0xe3},
+        {0xb1, 0x59, 0x28},
+    }};
+    return palette;
+}
+//____________________________________________________________________________
+rarexsec::plot::raster::Colour rarexsec::plot::raster::bird(double t)
+{
+    static constexpr int n = 9;
+    static constexpr double stops[n] = {0.0000, 0.1250, 0.2500, 0.3750, 0.5000, 0.6250, 0.7500, 0.8750, 1.0000};
+    static constexpr double red[n] = {0.2082, 0.0592, 0.0780, 0.0232, 0.1802, 0.5301, 0.8186, 0.9956, 0.9764};
+    static constexpr double green[n] = {0.1664, 0.3599, 0.5041, 0.6419, 0.7178, 0.7492, 0.7328, 0.7862, 0.9832};
+    static constexpr double blue[n] = {0.5293, 0.8684, 0.8385, 0.7914, 0.6425, 0.4662, 0.3499, 0.1968, 0.0539};
+
+    t = std::isfinite(t) ? std::clamp(t, 0.0, 1.0) : 0.0;
+    int i = 0;
+    while (i < n - 2 && t > stops[i + 1])
+        ++i;
+    const double f = (t - stops[i]) / (stops[i + 1] - stops[i]);
+    auto mix = [f, i](const double* c) {
+        return static_cast<std::uint8_t>(std::lround(255.0 * (c[i] + f * (c[i + 1] - c[i]))));
+    };
+    return {mix(red), mix(green), mix(blue)};
+}
+//____________________________________________________________________________
+static rarexsec::plot::raster::Image make_image(int w, int h, int scale)
+{
+    if (w <= 0 || h <= 0 || scale <= 0)
+        throw std::invalid_argument("raster: image dimensions must be positive");
+    rarexsec::plot::raster::Image img;
+    img.width = w * scale;
+    img.height = h * scale;
+    img.rgb.assign(static_cast<std::size_t>(img.width) * img.height * 3, 255);
+    return img;
+}
+//____________________________________________________________________________
+static void put(rarexsec::plot::raster::Image& img, int c, int r, int h, int scale,
+                const rarexsec::plot::raster::Colour& col)
+{
+    const int y0 = (h - 1 - r) * scale;
+    for (int dy = 0; dy < scale; ++dy) {
+        std::uint8_t* row = img.rgb.data() + (static_cast<std::size_t>(y0 + dy) * img.width + c * scale) * 3;
+        for (int dx = 0; dx < scale; ++dx) {
+            row[3 * dx + 0] = col[0];
+            row[3 * dx + 1] = col[1];
+            row[3 * dx + 2] = col[2];
+        }
+    }
+}
+//____________________________________________________________________________
+rarexsec::plot::raster::Image rarexsec::plot::raster::detector(const std::vector<float>& values, int w, int h,
+                                                               double threshold, double zmin, double zmax,
+                                                               bool log_z, int scale)
+{
+    auto img = make_image(w, h, scale);
+    const bool use_log = log_z && zmin > 0.0 && zmax > zmin;
+    const double lo = use_log ? std::log10(zmin) : zmin;
+    const double span = (use_log ? std::log10(zmax) : zmax) - lo;
+    const int n = static_cast<int>(values.size());
+    for (int r = 0; r < h; ++r) {
+        for (int c = 0; c < w; ++c) {
+            const int idx = r * w + c;
+            if (idx >= n)
+                break;
+            const double x = values[idx];
+            const double y = x > threshold ? std::min(x, zmax) : zmin;
+            const double z = use_log ? std::log10(std::max(y, zmin)) : y;
+            put(img, c, r, h, scale, bird(span > 0.0 ? (z - lo) / span : 0.0));
+        }
+    }
+    return img;
+}
+//____________________________________________________________________________
+rarexsec::plot::raster::Image rarexsec::plot::raster::semantic(const std::vector<int>& labels, int w, int h,
+                                                               int scale)
+{
+    auto img = make_image(w, h, scale);
+    const auto& palette = semantic_palette();
+    const int n = static_cast<int>(labels.size());
+    for (int r = 0; r < h; ++r) {
+        for (int c = 0; c < w; ++c) {
+            const int idx = r * w + c;
+            if (idx >= n)
+                break;
+            const int v = std::clamp(labels[idx], 0, semantic_palette_size - 1);
+            put(img, c, r, h, scale, palette[static_cast<std::size_t>(v)]);
+        }
+    }
+    return img;
+}
+//____________________________________________________________________________
+rarexsec::plot::raster::Grid<float> rarexsec::plot::raster::pool(const std::vector<float>& values, int w, int h,
+                                                                 int factor, Pooling mode)
+{
+    if (w <= 0 || h <= 0 || factor <= 0)
+        throw std::invalid_argument("raster: pooling needs a positive grid and factor");
+    Grid<float> out;
+    out.width = (w + factor - 1) / factor;
+    out.height = (h + factor - 1) / factor;
+    out.values.assign(static_cast<std::size_t>(out.width) * out.height, 0.f);
+    const int n = static_cast<int>(values.size());
+    for (int r = 0; r < h; ++r) {
+        for (int c = 0; c < w; ++c) {
+            const int idx = r * w + c;
+            if (idx >= n)
+                break;
+            float& cell = out.values[static_cast<std::size_t>(r / factor) * out.width + c / factor];
+            cell = mode == Pooling::Sum ? cell + values[idx] : std::max(cell, values[idx]);
+        }
+    }
+    return out;
+}
+//____________________________________________________________________________
+rarexsec::plot::raster::Grid<int> rarexsec::plot::raster::pool(const std::vector<int>& labels, int w, int h,
+                                                               int factor)
+{
+    if (w <= 0 || h <= 0 || factor <= 0)
+        throw std::invalid_argument("raster: pooling needs a positive grid and factor");
+    Grid<int> out;
+    out.width = (w + factor - 1) / factor;
+    out.height = (h + factor - 1) / factor;
+    out.values.assign(static_cast<std::size_t>(out.width) * out.height, 0);
+    const int n = static_cast<int>(labels.size());
+    std::array<int, semantic_palette_size> counts{};
+    for (int br = 0; br < out.height; ++br) {
+        for (int bc = 0; bc < out.width; ++bc) {
+            counts.fill(0);
+            for (int r = br * factor; r < std::min(h, (br + 1) * factor); ++r) {
+                for (int c = bc * factor; c < std::min(w, (bc + 1) * factor); ++c) {
+                    const int idx = r * w + c;
+                    if (idx < n)
+                        ++counts[static_cast<std::size_t>(std::clamp(labels[idx], 0, semantic_palette_size - 1))];
+                }
+            }
+            int best = 0;
+            for (int k = 1; k < semantic_palette_size; ++k) {
+                if (counts[k] > 0 && (best == 0 || counts[k] > counts[best]))
+                    best = k;
+            }
+            out.values[static_cast<std::size_t>(br) * out.width + bc] = best;
+        }
+    }
+    return out;
+}
+//____________________________________________________________________________
+// Paints `col` over the first n pixels of a w x h grid, row-major from the bottom.
+static void fill(rarexsec::plot::raster::Image& img, int w, int h, int n, int scale,
+                 const rarexsec::plot::raster::Colour& col)
+{
+    for (int r = 0; r < h && r * w < n; ++r) {
+        for (int c = 0; c < w && r * w + c < n; ++c)
+            put(img, c, r, h, scale, col);
+    }
+}
+//____________________________________________________________________________
+rarexsec::plot::raster::Image rarexsec::plot::raster::detector(const sparse::Image<float>& values, int w, int h,
+                                                               double threshold, double zmin, double zmax,
+                                                               bool log_z, int scale)
+{
+    auto img = make_image(w, h, scale);
+    const bool use_log = log_z && zmin > 0.0 && zmax > zmin;
+    const double lo = use_log ? std::log10(zmin) : zmin;
+    const double span = (use_log ? std::log10(zmax) : zmax) - lo;
+    const long long cells = static_cast<long long>(w) * h;
+    const int n = static_cast<int>(std::min<long long>(values.size, cells));
+    fill(img, w, h, n, scale, bird(0.0));
+    const std::size_t nnz = std::min(values.index.size(), values.value.size());
+    for (std::size_t i = 0; i < nnz; ++i) {
+        const int idx = static_cast<int>(values.index[i]);
+        const double x = values.value[i];
+        if (values.index[i] >= static_cast<unsigned int>(n) || !(x > threshold))
+            continue;
+        const double y = std::min(x, zmax);
+        const double z = use_log ? std::log10(std::max(y, zmin)) : y;
+        put(img, idx % w, idx / w, h, scale, bird(span > 0.0 ? (z - lo) / span : 0.0));
+    }
+    return img;
+}
+//____________________________________________________________________________
+rarexsec::plot::raster::Image rarexsec::plot::raster::semantic(const sparse::Image<int>& labels, int w, int h,
+                                                               int scale)
+{
+    auto img = make_image(w, h, scale);
+    const auto& palette = semantic_palette();
+    const long long cells = static_cast<long long>(w) * h;
+    const int n = static_cast<int>(std::min<long long>(labels.size, cells));
+    fill(img, w, h, n, scale, palette[0]);
+    const std::size_t nnz = std::min(labels.index.size(), labels.value.size());
+    for (std::size_t i = 0; i < nnz; ++i) {
+        if (labels.index[i] >= static_cast<unsigned int>(n))
+            continue;
+        const int idx = static_cast<int>(labels.index[i]);
+        const int v = std::clamp(labels.value[i], 0, semantic_palette_size - 1);
+        put(img, idx % w, idx / w, h, scale, palette[static_cast<std::size_t>(v)]);
+    }
+    return img;
+}
+//____________________________________________________________________________
+rarexsec::plot::raster::Grid<float> rarexsec::plot::raster::pool(const sparse::Image<float>& values, int w, int h,
+                                                                 int factor, Pooling mode)
+{
+    if (w <= 0 || h <= 0 || factor <= 0)
+        throw std::invalid_argument("raster: pooling needs a positive grid and factor");
+    Grid<float> out;
+    out.width = (w + factor - 1) / factor;
+    out.height = (h + factor - 1) / factor;
+    out.values.assign(static_cast<std::size_t>(out.width) * out.height, 0.f);
+    const long long n = std::min<long long>(values.size, static_cast<long long>(w) * h);
+    const std::size_t nnz = std::min(values.index.size(), values.value.size());
+    for (std::size_t i = 0; i < nnz; ++i) {
+        if (values.index[i] >= n)
+            continue;
+        const int idx = static_cast<int>(values.index[i]);
+        float& cell = out.values[static_cast<std::size_t>(idx / w / factor) * out.width + (idx % w) / factor];
+        cell = mode == Pooling::Sum ? cell + values.value[i] : std::max(cell, values.value[i]);
+    }
+    return out;
+}
+//____________________________________________________________________________
+rarexsec::plot::raster::Grid<int> rarexsec::plot::raster::pool(const sparse::Image<int>& labels, int w, int h,
+                                                               int factor)
+{
+    if (w <= 0 || h <= 0 || factor <= 0)
+        throw std::invalid_argument("raster: pooling needs a positive grid and factor");
+    Grid<int> out;
+    out.width = (w + factor - 1) / factor;
+    out.height = (h + factor - 1) / factor;
+    out.values.assign(static_cast<std::size_t>(out.width) * out.height, 0);
+    // Background never wins a block, so only the listed labels need counting.
+    std::vector<std::array<int, semantic_palette_size>> counts(out.values.size());
+    const long long n = std::min<long long>(labels.size, static_cast<long long>(w) * h);
+    const std::size_t nnz = std::min(labels.index.size(), labels.value.size());
+    for (std::size_t i = 0; i < nnz; ++i) {
+        if (labels.index[i] >= n)
+            continue;
+        const int idx = static_cast<int>(labels.index[i]);
+        const int v = std::clamp(labels.value[i], 0, semantic_palette_size - 1);
+        ++counts[static_cast<std::size_t>(idx / w / factor) * out.width + (idx % w) / factor][static_cast<std::size_t>(v)];
+    }
+    for (std::size_t b = 0; b < counts.size(); ++b) {
+        int best = 0;
+        for (int k = 1; k < semantic_palette_size; ++k) {
+            if (counts[b][k] > 0 && (best == 0 || counts[b][k] > counts[b][best]))
+                best = k;
+        }
+        out.values[b] = best;
+    }
+    return out;
+}
+//____________________________________________________________________________
+rarexsec::plot::raster::Image rarexsec::plot::raster::crop(const Image& img, int x, int y, int w, int h)
+{
+    x = std::clamp(x, 0, img.width);
+    y = std::clamp(y, 0, img.height);
+    w = std::clamp(w, 0, img.width - x);
+    h = std::clamp(h, 0, img.height - y);
+    Image out;
+    out.width = w;
+    out.height = h;
+    out.rgb.resize(static_cast<std::size_t>(w) * h * 3);
+    for (int r = 0; r < h; ++r) {
+        const auto* src = img.rgb.data() + (static_cast<std::size_t>(y + r) * img.width + x) * 3;
+        std::copy(src, src + static_cast<std::size_t>(w) * 3, out.rgb.data() + static_cast<std::size_t>(r) * w * 3);
+    }
+    return out;
+}
+//____________________________________________________________________________
+int rarexsec::plot::raster::write_tiles(const Image& img, int tile, const std::string& dir)
+{
+    if (tile <= 0)
+        throw std::invalid_argument("raster: tile size must be positive");
+    std::filesystem::create_directories(dir);
+    int count = 0;
+    for (int ty = 0; ty * tile < img.height; ++ty) {
+        for (int tx = 0; tx * tile < img.width; ++tx) {
+            char name[32];
+            std::snprintf(name, sizeof(name), "%d_%d.png", tx, ty);
+            write_png(crop(img, tx * tile, ty * tile, tile, tile), (std::filesystem::path(dir) / name).string());
+            ++count;
+        }
+    }
+    return count;
+}
+//____________________________________________________________________________
+static void append_u32(std::vector<std::uint8_t>& out, std::uint32_t v)
+{
+    out.push_back(static_cast<std::uint8_t>(v >> 24));
+    out.push_back(static_cast<std::uint8_t>(v >> 16));
+    out.push_back(static_cast<std::uint8_t>(v >> 8));
+    out.push_back(static_cast<std::uint8_t>(v));
+}
+//____________________________________________________________________________
+static void append_chunk(std::vector<std::uint8_t>& out, const char* type, const std::vector<std::uint8_t>& data)
+{
+    append_u32(out, static_cast<std::uint32_t>(data.size()));
+    const std::size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    const uLong crc = crc32(0L, out.data() + start, static_cast<uInt>(out.size() - start));
+    append_u32(out, static_cast<std::uint32_t>(crc));
+}
+//____________________________________________________________________________
+std::vector<std::uint8_t> rarexsec::plot::raster::encode_png(const Image& img, int level)
+{
+    const std::size_t stride = static_cast<std::size_t>(img.width) * 3;
+    if (img.width <= 0 || img.height <= 0 || img.rgb.size() != stride * img.height)
+        throw std::invalid_argument("raster: malformed image");
+
+    std::vector<std::uint8_t> raw;
+    raw.reserve((stride + 1) * img.height);
+    for (int y = 0; y < img.height; ++y) {
+        raw.push_back(0);
+        const auto* row = img.rgb.data() + stride * y;
+        raw.insert(raw.end(), row, row + stride);
+    }
+
+    uLongf packed_size = compressBound(static_cast<uLong>(raw.size()));
+    std::vector<std::uint8_t> packed(packed_size);
+    if (compress2(packed.data(), &packed_size, raw.data(), static_cast<uLong>(raw.size()), level) != Z_OK)
+        throw std::runtime_error("raster: zlib compression failed");
+    packed.resize(packed_size);
+
+    std::vector<std::uint8_t> header;
+    append_u32(header, static_cast<std::uint32_t>(img.width));
+    append_u32(header, static_cast<std::uint32_t>(img.height));
+    header.insert(header.end(), {8, 2, 0, 0, 0});
+
+    std::vector<std::uint8_t> out{0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    append_chunk(out, "IHDR", header);
+    append_chunk(out, "IDAT", packed);
+    append_chunk(out, "IEND", {});
+    return out;
+}
+//____________________________________________________________________________
+void rarexsec::plot::raster::write_png(const Image& img, const std::string& path, int level)
+{
+    const auto bytes = encode_png(img, level);
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out)
+        throw std::runtime_error("raster: cannot open " + path);
+    out.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+}
+//____________________________________________________________________________
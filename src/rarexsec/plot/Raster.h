@@ -0,0 +1,63 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "rarexsec/proc/SparseImage.h"
+
+namespace rarexsec::plot::raster {
+
+struct Image {
+    int width = 0;
+    int height = 0;
+    std::vector<std::uint8_t> rgb;
+};
+
+using Colour = std::array<std::uint8_t, 3>;
+
+template <class T>
+struct Grid {
+    int width = 0;
+    int height = 0;
+    std::vector<T> values;
+};
+
+enum class Pooling { Max,
+                     Sum };
+
+inline constexpr int semantic_palette_size = 15;
+
+const std::array<Colour, semantic_palette_size>& semantic_palette();
+
+Colour bird(double t);
+
+Image detector(const std::vector<float>& values, int w, int h,
+               double threshold, double zmin, double zmax, bool log_z, int scale = 1);
+
+Image semantic(const std::vector<int>& labels, int w, int h, int scale = 1);
+
+// Sparse images paint the background once and then only their listed pixels.
+Image detector(const sparse::Image<float>& values, int w, int h,
+               double threshold, double zmin, double zmax, bool log_z, int scale = 1);
+
+Image semantic(const sparse::Image<int>& labels, int w, int h, int scale = 1);
+
+Grid<float> pool(const std::vector<float>& values, int w, int h, int factor, Pooling mode);
+
+Grid<int> pool(const std::vector<int>& labels, int w, int h, int factor);
+
+Grid<float> pool(const sparse::Image<float>& values, int w, int h, int factor, Pooling mode);
+
+Grid<int> pool(const sparse::Image<int>& labels, int w, int h, int factor);
+
+Image crop(const Image& img, int x, int y, int w, int h);
+
+int write_tiles(const Image& img, int tile, const std::string& dir);
+
+std::vector<std::uint8_t> encode_png(const Image& img, int level = 6);
+
+void write_png(const Image& img, const std::string& path, int level = 6);
+
+}
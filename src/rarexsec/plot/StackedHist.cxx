@@ -9,6 +9,12 @@
 #include "TMatrixDSym.h"
 #include "rarexsec/plot/Plotter.h"
 #include "rarexsec/plot/Channels.h"
+#include "rarexsec/proc/ColumnTrace.h"
+#include "rarexsec/proc/Expression.h"
+#include "rarexsec/proc/Memory.h"
+#include "rarexsec/proc/Profile.h"
+#include "rarexsec/proc/Progress.h"
+#include "rarexsec/proc/ResultStore.h"
 #include <algorithm>
 #include <cmath>
 #include <filesystem>
@@ -32,6 +38,17 @@ static void apply_total_errors(TH1D& h, const TMatrixDSym* cov, const std::vecto
     }
 }
 
+static std::string store_key(const rarexsec::Entry& e, const rarexsec::plot::TH1DModel& spec,
+                             const std::string& what, const std::string& weight) {
+    return rarexsec::store::hist_key(e, e.nominal, "",
+                                     {{"plot", "stacked"},
+                                      {"var", spec.expr.empty() ? spec.id : spec.expr},
+                                      {"weight", weight},
+                                      {"sel", rarexsec::selection::preset_to_string(spec.sel)},
+                                      {"bins", {spec.nbins, spec.xmin, spec.xmax}},
+                                      {"part", what}});
+}
+
 static std::string selection_label(rarexsec::selection::Preset preset) {
     using rarexsec::selection::Preset;
     switch (preset) {
@@ -137,6 +154,8 @@ void rarexsec::plot::StackedHist::setup_pads(TCanvas& c, TPad*& p_main, TPad*& p
 }
 
 void rarexsec::plot::StackedHist::build_histograms() {
+    profile::Scope scope("stacked:" + spec_.id);
+    memory::Stage stage("stacked:" + spec_.id);
     const auto axes = spec_.axis_title();
     stack_ = std::make_unique<THStack>((spec_.id + "_stack").c_str(), axes.c_str());
     mc_ch_hists_.clear();
@@ -144,21 +163,38 @@ void rarexsec::plot::StackedHist::build_histograms() {
     data_hist_.reset();
     sig_hist_.reset();
     signal_scale_ = 1.0;
-    std::map<int, std::vector<ROOT::RDF::RResultPtr<TH1D>>> booked;
+    std::map<int, std::vector<store::Part>> booked;
     const auto& channels = rarexsec::plot::Channels::mc_keys();
+    const auto lease = memory::book(spec_.model(), mc_.size() * channels.size() + data_.size(), "stacked:" + spec_.id);
 
     for (size_t ie = 0; ie < mc_.size(); ++ie) {
         const Entry* e = mc_[ie];
         if (!e)
             continue;
-        auto n0 = selection::apply(e->rnode(), spec_.sel, *e);
-        auto n = (spec_.expr.empty() ? n0 : n0.Define("_rx_expr_", spec_.expr));
-        const std::string var = spec_.expr.empty() ? spec_.id : "_rx_expr_";
+        std::vector<store::Part> parts;
+        bool all_hit = true;
         for (int ch : channels) {
-            auto nf = n.Filter([ch](int c) { return c == ch; }, {"analysis_channels"});
-            auto h = nf.Histo1D(spec_.model("_mc_ch" + std::to_string(ch) + "_src" + std::to_string(ie)), var, spec_.weight);
-            booked[ch].push_back(h);
+            parts.push_back(store::lookup(store_key(*e, spec_, "mc_ch" + std::to_string(ch), spec_.weight),
+                                          spec_.model("_mc_ch" + std::to_string(ch) + "_src" + std::to_string(ie))));
+            all_hit = all_hit && parts.back().hit;
+        }
+        if (!all_hit || trace::enabled()) {
+            if (!all_hit)
+                progress::expect(e->nominal);
+            auto n0 = selection::apply(e->rnode(), spec_.sel, *e);
+            auto n = (spec_.expr.empty() ? n0 : expr::define(n0, "_rx_expr_", spec_.expr));
+            const std::string var = spec_.expr.empty() ? spec_.id : "_rx_expr_";
+            trace::use({spec_.expr.empty() ? spec_.id : std::string{}, spec_.weight, "analysis_channels"});
+            for (size_t ic = 0; ic < channels.size(); ++ic) {
+                if (parts[ic].hit)
+                    continue;
+                const int ch = channels[ic];
+                auto nf = n.Filter([ch](int c) { return c == ch; }, {"analysis_channels"});
+                parts[ic].booked = expr::histo1d(nf, spec_.model("_mc_ch" + std::to_string(ch) + "_src" + std::to_string(ie)), var, spec_.weight);
+            }
         }
+        for (size_t ic = 0; ic < channels.size(); ++ic)
+            booked[channels[ic]].push_back(std::move(parts[ic]));
     }
 
     std::vector<int> order;
@@ -170,8 +206,8 @@ void rarexsec::plot::StackedHist::build_histograms() {
         if (it == booked.end() || it->second.empty())
             continue;
         std::unique_ptr<TH1D> sum;
-        for (auto& rr : it->second) {
-            const TH1D& h = rr.GetValue();
+        for (auto& part : it->second) {
+            const TH1D& h = part.get();
             if (!sum) {
                 sum.reset(static_cast<TH1D*>(h.Clone((spec_.id + "_mc_sum_ch" + std::to_string(ch)).c_str())));
                 sum->SetDirectory(nullptr);
@@ -218,18 +254,27 @@ void rarexsec::plot::StackedHist::build_histograms() {
     }
 
     if (!data_.empty()) {
-        std::vector<ROOT::RDF::RResultPtr<TH1D>> parts;
+        std::vector<store::Part> parts;
         for (size_t ie = 0; ie < data_.size(); ++ie) {
             const Entry* e = data_[ie];
             if (!e)
                 continue;
+            const auto model = spec_.model("_data_src" + std::to_string(ie));
+            parts.push_back(store::lookup(store_key(*e, spec_, "data", ""), model));
+            auto& part = parts.back();
+            if (part.hit && !trace::enabled())
+                continue;
             auto n0 = selection::apply(e->rnode(), spec_.sel, *e);
-            auto n = (spec_.expr.empty() ? n0 : n0.Define("_rx_expr_", spec_.expr));
+            auto n = (spec_.expr.empty() ? n0 : expr::define(n0, "_rx_expr_", spec_.expr));
             const std::string var = spec_.expr.empty() ? spec_.id : "_rx_expr_";
-            parts.push_back(n.Histo1D(spec_.model("_data_src" + std::to_string(ie)), var));
+            trace::use(spec_.expr.empty() ? spec_.id : std::string{});
+            if (!part.hit) {
+                progress::expect(e->nominal);
+                part.booked = expr::histo1d(n, model, var);
+            }
         }
-        for (auto& rr : parts) {
-            const TH1D& h = rr.GetValue();
+        for (auto& part : parts) {
+            const TH1D& h = part.get();
             if (!data_hist_) {
                 data_hist_.reset(static_cast<TH1D*>(h.Clone((spec_.id + "_data").c_str())));
                 data_hist_->SetDirectory(nullptr);
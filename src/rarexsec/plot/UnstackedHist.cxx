@@ -23,8 +23,25 @@
 #include "rarexsec/Hub.h"
 #include "rarexsec/plot/Plotter.h"
 #include "rarexsec/plot/Channels.h"
+#include "rarexsec/proc/ColumnTrace.h"
+#include "rarexsec/proc/Expression.h"
+#include "rarexsec/proc/Memory.h"
+#include "rarexsec/proc/Profile.h"
+#include "rarexsec/proc/Progress.h"
+#include "rarexsec/proc/ResultStore.h"
 #include "rarexsec/proc/Selection.h"
 
+static std::string store_key(const rarexsec::Entry& e, const rarexsec::plot::TH1DModel& spec,
+                             const std::vector<double>& edges, const std::string& what, const std::string& weight) {
+    return rarexsec::store::hist_key(e, e.nominal, "",
+                                     {{"plot", "unstacked"},
+                                      {"var", spec.expr.empty() ? spec.id : spec.expr},
+                                      {"weight", weight},
+                                      {"sel", rarexsec::selection::preset_to_string(spec.sel)},
+                                      {"edges", edges},
+                                      {"part", what}});
+}
+
 static void normalise_pdf(TH1D& h) {
     const double area = h.Integral("width");
     if (area > 0.0)
@@ -109,6 +126,8 @@ void rarexsec::plot::UnstackedHist::setup_pads(TCanvas& c, TPad*& p_main, TPad*&
 }
 
 void rarexsec::plot::UnstackedHist::build_histograms() {
+    profile::Scope scope("unstacked:" + spec_.id);
+    memory::Stage stage("unstacked:" + spec_.id);
     mc_ch_hists_.clear();
     data_hist_.reset();
     chan_order_.clear();
@@ -120,28 +139,47 @@ void rarexsec::plot::UnstackedHist::build_histograms() {
         throw std::runtime_error("log-spaced histogram requires at least two bin edges");
     }
 
-    std::map<int, std::vector<ROOT::RDF::RResultPtr<TH1D>>> booked_mc;
+    std::map<int, std::vector<store::Part>> booked_mc;
     const auto& channels = rarexsec::plot::Channels::mc_keys();
+    const auto lease = memory::book(ROOT::RDF::TH1DModel("", "", nbins, log_edges.data()),
+                                    mc_.size() * channels.size() + data_.size(), "unstacked:" + spec_.id);
 
     for (size_t ie = 0; ie < mc_.size(); ++ie) {
         const Entry* e = mc_[ie];
         if (!e)
             continue;
 
-        auto n0 = selection::apply(e->rnode(), spec_.sel, *e);
-        auto n = (spec_.expr.empty() ? n0 : n0.Define("_rx_expr_", spec_.expr));
-        const std::string var = spec_.expr.empty() ? spec_.id : "_rx_expr_";
-
+        std::vector<ROOT::RDF::TH1DModel> models;
+        std::vector<store::Part> parts;
+        bool all_hit = true;
         for (int ch : channels) {
-            auto nf = n.Filter([ch](int c) { return c == ch; }, {"analysis_channels"});
-            ROOT::RDF::TH1DModel model(
-                (spec_.id + "_mc_ch" + std::to_string(ch) + "_src" + std::to_string(ie)).c_str(),
-                "",
-                nbins,
-                log_edges.data());
-            auto h = nf.Histo1D(model, var, spec_.weight);
-            booked_mc[ch].push_back(h);
+            models.emplace_back((spec_.id + "_mc_ch" + std::to_string(ch) + "_src" + std::to_string(ie)).c_str(),
+                                "",
+                                nbins,
+                                log_edges.data());
+            parts.push_back(store::lookup(store_key(*e, spec_, log_edges, "mc_ch" + std::to_string(ch), spec_.weight),
+                                          models.back()));
+            all_hit = all_hit && parts.back().hit;
+        }
+
+        if (!all_hit || trace::enabled()) {
+            if (!all_hit)
+                progress::expect(e->nominal);
+            auto n0 = selection::apply(e->rnode(), spec_.sel, *e);
+            auto n = (spec_.expr.empty() ? n0 : expr::define(n0, "_rx_expr_", spec_.expr));
+            const std::string var = spec_.expr.empty() ? spec_.id : "_rx_expr_";
+            trace::use({spec_.expr.empty() ? spec_.id : std::string{}, spec_.weight, "analysis_channels"});
+
+            for (size_t ic = 0; ic < channels.size(); ++ic) {
+                if (parts[ic].hit)
+                    continue;
+                const int ch = channels[ic];
+                auto nf = n.Filter([ch](int c) { return c == ch; }, {"analysis_channels"});
+                parts[ic].booked = expr::histo1d(nf, models[ic], var, spec_.weight);
+            }
         }
+        for (size_t ic = 0; ic < channels.size(); ++ic)
+            booked_mc[channels[ic]].push_back(std::move(parts[ic]));
     }
 
     std::vector<std::pair<int, double>> yields;
@@ -153,8 +191,8 @@ void rarexsec::plot::UnstackedHist::build_histograms() {
             continue;
 
         std::unique_ptr<TH1D> sum;
-        for (auto& rr : it->second) {
-            const TH1D& h = rr.GetValue();
+        for (auto& part : it->second) {
+            const TH1D& h = part.get();
             if (!sum) {
                 sum.reset(static_cast<TH1D*>(h.Clone((spec_.id + "_sum_ch" + std::to_string(ch)).c_str())));
                 sum->SetDirectory(nullptr);
@@ -193,22 +231,30 @@ void rarexsec::plot::UnstackedHist::build_histograms() {
     }
 
     if (!data_.empty()) {
-        std::vector<ROOT::RDF::RResultPtr<TH1D>> parts;
+        std::vector<store::Part> parts;
         for (size_t ie = 0; ie < data_.size(); ++ie) {
             const Entry* e = data_[ie];
             if (!e)
                 continue;
-            auto n0 = selection::apply(e->rnode(), spec_.sel, *e);
-            auto n = (spec_.expr.empty() ? n0 : n0.Define("_rx_expr_", spec_.expr));
-            const std::string var = spec_.expr.empty() ? spec_.id : "_rx_expr_";
             ROOT::RDF::TH1DModel model((spec_.id + "_data_src" + std::to_string(ie)).c_str(),
                                        "",
                                        nbins,
                                        log_edges.data());
-            parts.push_back(n.Histo1D(model, var));
+            parts.push_back(store::lookup(store_key(*e, spec_, log_edges, "data", ""), model));
+            auto& part = parts.back();
+            if (part.hit && !trace::enabled())
+                continue;
+            auto n0 = selection::apply(e->rnode(), spec_.sel, *e);
+            auto n = (spec_.expr.empty() ? n0 : expr::define(n0, "_rx_expr_", spec_.expr));
+            const std::string var = spec_.expr.empty() ? spec_.id : "_rx_expr_";
+            trace::use(spec_.expr.empty() ? spec_.id : std::string{});
+            if (!part.hit) {
+                progress::expect(e->nominal);
+                part.booked = expr::histo1d(n, model, var);
+            }
         }
-        for (auto& rr : parts) {
-            const TH1D& h = rr.GetValue();
+        for (auto& part : parts) {
+            const TH1D& h = part.get();
             if (!data_hist_) {
                 data_hist_.reset(static_cast<TH1D*>(h.Clone((spec_.id + "_data").c_str())));
                 data_hist_->SetDirectory(nullptr);
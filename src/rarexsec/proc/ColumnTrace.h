@@ -0,0 +1,168 @@
+#pragma once
+#include <ROOT/RDataFrame.hxx>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace rarexsec {
+namespace trace {
+
+// Records the columns read by the filters, defines and actions the library books.
+// Enabled with RAREXSEC_TRACE_COLUMNS=<path>; the list is written to <path> at exit.
+// RAREXSEC_TRACE_DRYRUN=1 additionally makes every Hub frame reject all entries,
+// so a macro books and runs its graph without reading any branch.
+class Recorder {
+  public:
+    static Recorder& instance() {
+        static Recorder r;
+        return r;
+    }
+
+    bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+    void enable(bool on = true) { enabled_.store(on, std::memory_order_relaxed); }
+
+    void use(const std::string& column) {
+        if (!enabled() || column.empty())
+            return;
+        std::lock_guard<std::mutex> lock(mutex_);
+        used_.insert(column);
+    }
+
+    std::vector<std::string> used() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return {used_.begin(), used_.end()};
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        used_.clear();
+    }
+
+    void write(const std::string& path) const {
+        std::ofstream out(path);
+        if (!out)
+            throw std::runtime_error("cannot write column trace " + path);
+        out << nlohmann::json(used()).dump(2) << "\n";
+    }
+
+    ~Recorder() {
+        if (path_.empty())
+            return;
+        try {
+            write(path_);
+        } catch (...) {
+        }
+    }
+
+  private:
+    Recorder() {
+        const char* p = std::getenv("RAREXSEC_TRACE_COLUMNS");
+        if (p && *p) {
+            path_ = p;
+            enabled_ = true;
+        }
+    }
+
+    std::atomic<bool> enabled_{false};
+    std::string path_;
+    mutable std::mutex mutex_;
+    std::set<std::string> used_;
+};
+
+inline bool enabled() { return Recorder::instance().enabled(); }
+
+inline bool dry_run() {
+    const char* p = std::getenv("RAREXSEC_TRACE_DRYRUN");
+    return enabled() && p && *p && std::string(p) != "0";
+}
+
+inline void use(const std::string& column) { Recorder::instance().use(column); }
+
+inline void use(const std::vector<std::string>& columns) {
+    if (!enabled())
+        return;
+    for (const auto& c : columns)
+        use(c);
+}
+
+// Candidate column names in a jitted expression: identifiers that are not
+// namespace qualifiers, member accesses or function calls.
+inline std::vector<std::string> identifiers(const std::string& expr) {
+    std::vector<std::string> out;
+    const auto n = expr.size();
+    auto ident = [](char c) { return std::isalnum(static_cast<unsigned char>(c)) || c == '_'; };
+    std::size_t i = 0;
+    while (i < n) {
+        const char c = expr[i];
+        if (c == '"' || c == '\'') {
+            for (++i; i < n && expr[i] != c; ++i)
+                if (expr[i] == '\\')
+                    ++i;
+            ++i;
+            continue;
+        }
+        if (std::isdigit(static_cast<unsigned char>(c))) {
+            while (i < n && (ident(expr[i]) || expr[i] == '.'))
+                ++i;
+            continue;
+        }
+        if (!ident(c)) {
+            ++i;
+            continue;
+        }
+        const std::size_t b = i;
+        while (i < n && ident(expr[i]))
+            ++i;
+        std::size_t p = b;
+        while (p > 0 && std::isspace(static_cast<unsigned char>(expr[p - 1])))
+            --p;
+        const bool member = p > 0 && (expr[p - 1] == '.' ||
+                                      (p > 1 && expr[p - 2] == ':' && expr[p - 1] == ':') ||
+                                      (p > 1 && expr[p - 2] == '-' && expr[p - 1] == '>'));
+        std::size_t q = i;
+        while (q < n && std::isspace(static_cast<unsigned char>(expr[q])))
+            ++q;
+        const bool call = q < n && (expr[q] == '(' || (q + 1 < n && expr[q] == ':' && expr[q + 1] == ':'));
+        if (!member && !call)
+            out.push_back(expr.substr(b, i - b));
+    }
+    return out;
+}
+
+inline void use_expr(const std::string& expr) {
+    if (!enabled())
+        return;
+    use(identifiers(expr));
+}
+
+// Traced columns that exist in the given node, ready for snapshot::Options::columns.
+inline std::vector<std::string> minimal_columns(ROOT::RDF::RNode node) {
+    const auto available = node.GetColumnNames();
+    const std::unordered_set<std::string> have(available.begin(), available.end());
+    std::vector<std::string> out;
+    for (const auto& c : Recorder::instance().used())
+        if (have.count(c))
+            out.push_back(c);
+    return out;
+}
+
+inline std::vector<std::string> load(const std::string& path) {
+    std::ifstream in(path);
+    if (!in)
+        throw std::runtime_error("cannot open column trace " + path);
+    nlohmann::json j;
+    in >> j;
+    return j.get<std::vector<std::string>>();
+}
+
+}
+}
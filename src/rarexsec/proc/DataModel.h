@@ -11,8 +11,14 @@
 #include <utility>
 #include <vector>
 
+class TTree;
+
 namespace rarexsec {
 
+namespace progress {
+struct Counter;
+}
+
 enum class Source { Data,
                     Ext,
                     MC };
@@ -133,8 +139,14 @@ inline origin from_source_slice(Source src, Slice sl) {
 }
 
 struct Frame {
+    std::shared_ptr<TTree> source;
     std::shared_ptr<ROOT::RDataFrame> df;
     mutable std::optional<ROOT::RDF::RNode> node;
+    std::vector<std::string> files;
+    std::string skim_tree;
+    bool skim_rntuple = false;
+    std::unordered_map<std::string, double> scales;
+    std::shared_ptr<progress::Counter> progress;
 
     Frame() = default;
     Frame(std::shared_ptr<ROOT::RDataFrame> df_in, ROOT::RDF::RNode node_in)
@@ -151,6 +163,11 @@ struct Frame {
             throw std::runtime_error("Frame::rnode: node is not initialised");
         return *node;
     }
+
+    double scale(const std::string& column, double fallback) const {
+        auto it = scales.find(column);
+        return it == scales.end() ? fallback : it->second;
+    }
 };
 
 struct Entry {
@@ -160,6 +177,10 @@ struct Entry {
     sample::origin kind = sample::origin::unknown;
     std::vector<std::string> files;
     std::string file;
+    std::vector<std::string> skim_files;
+    std::string skim_tree;
+    bool skim_rntuple = false;
+    std::unordered_map<std::string, double> skim_scales;
 
     double pot_nom = 0.0, pot_eqv = 0.0;
     double trig_nom = 0.0, trig_eqv = 0.0;
@@ -167,6 +188,7 @@ struct Entry {
     Frame nominal;
     std::unordered_map<std::string, Frame> detvars;
 
+    bool skimmed() const { return !skim_tree.empty(); }
     ROOT::RDF::RNode rnode() const { return nominal.rnode(); }
     const Frame* detvar(const std::string& tag) const {
         auto it = detvars.find(tag);
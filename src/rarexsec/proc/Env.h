@@ -11,7 +11,7 @@
 
 namespace rarexsec {
 struct Env {
-  std::string cfg, beamline;
+  std::string cfg, beamline, tree;
   std::vector<std::string> periods;
   static Env from_env() {
     auto get_env = [](const char* key) {
@@ -28,6 +28,10 @@ struct Env {
     if (env.beamline.empty()) {
       throw std::runtime_error("RAREXSEC_BEAMLINE missing");
     }
+    env.tree = get_env("RAREXSEC_TREE");
+    if (env.tree.empty()) {
+      env.tree = "analysis";
+    }
     auto periods = get_env("RAREXSEC_PERIODS");
     if (periods.empty()) {
       throw std::runtime_error("RAREXSEC_PERIODS missing");
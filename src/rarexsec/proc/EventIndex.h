@@ -0,0 +1,288 @@
+#pragma once
+#include <RtypesCore.h>
+#include <TChain.h>
+#include <TEntryList.h>
+#include <TFile.h>
+#include <TLeaf.h>
+#include <TNamed.h>
+#include <TTree.h>
+#include <nlohmann/json.hpp>
+
+#include "rarexsec/proc/FileStamp.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace rarexsec {
+namespace events {
+
+struct Key {
+    int run = 0;
+    int sub = 0;
+    int evt = 0;
+
+    friend bool operator<(const Key& a, const Key& b) {
+        return std::tie(a.run, a.sub, a.evt) < std::tie(b.run, b.sub, b.evt);
+    }
+    friend bool operator==(const Key& a, const Key& b) {
+        return a.run == b.run && a.sub == b.sub && a.evt == b.evt;
+    }
+};
+
+struct Location {
+    std::size_t file = 0;
+    Long64_t entry = -1;
+};
+
+// Outcome of looking events up: the entries to read in file/entry order, the
+// requested keys the index does not hold and those held by more than one entry.
+struct Lookup {
+    std::vector<Location> found;
+    std::vector<Key> missing;
+    std::vector<Key> duplicated;
+};
+
+struct Columns {
+    std::string run = "run";
+    std::string sub = "sub";
+    std::string evt = "evt";
+};
+
+inline constexpr const char* index_tree_name = "event_index";
+inline constexpr const char* index_meta_name = "event_index_meta";
+
+// Maps (run, sub, evt) to (file, entry) for one sample so that a handful of
+// events can be read through a TEntryList instead of a filtered full pass.
+class Index {
+  public:
+    Index() = default;
+
+    static Index build(const std::string& tree, const std::vector<std::string>& files, const Columns& cols = {}) {
+        Index idx;
+        idx.tree_ = tree;
+        idx.files_ = files;
+        idx.cols_ = cols;
+        for (std::size_t f = 0; f < files.size(); ++f) {
+            std::unique_ptr<TFile> file{TFile::Open(files[f].c_str(), "READ")};
+            if (!file || file->IsZombie())
+                throw std::runtime_error("event index: cannot open " + files[f]);
+            auto* t = file->Get<TTree>(tree.c_str());
+            if (!t)
+                throw std::runtime_error("event index: no tree " + tree + " in " + files[f]);
+            t->SetBranchStatus("*", false);
+            TLeaf* run = leaf(*t, cols.run, "run");
+            TLeaf* sub = leaf(*t, cols.sub, "subrun");
+            TLeaf* evt = leaf(*t, cols.evt, "event");
+            const Long64_t n = t->GetEntries();
+            idx.records_.reserve(idx.records_.size() + static_cast<std::size_t>(n));
+            for (Long64_t i = 0; i < n; ++i) {
+                run->GetBranch()->GetEntry(i);
+                sub->GetBranch()->GetEntry(i);
+                evt->GetBranch()->GetEntry(i);
+                Key k{static_cast<int>(run->GetValue()), static_cast<int>(sub->GetValue()),
+                      static_cast<int>(evt->GetValue())};
+                idx.records_.push_back({k, {f, i}});
+            }
+        }
+        idx.sort();
+        if (const auto dups = idx.duplicates(); !dups.empty())
+            std::cerr << "[events] " << dups.size() << " (run, sub, evt) keys appear in more than one entry of "
+                      << tree << ", e.g. " << dups.front().run << ":" << dups.front().sub << ":"
+                      << dups.front().evt << "; lookups return every entry" << '\n';
+        return idx;
+    }
+
+    static Index load(const std::string& path) {
+        std::unique_ptr<TFile> file{TFile::Open(path.c_str(), "READ")};
+        if (!file || file->IsZombie())
+            throw std::runtime_error("event index: cannot open " + path);
+        std::unique_ptr<TNamed> meta{file->Get<TNamed>(index_meta_name)};
+        auto* t = file->Get<TTree>(index_tree_name);
+        if (!meta || !t)
+            throw std::runtime_error("event index: " + path + " is not an event index");
+        const auto j = nlohmann::json::parse(meta->GetTitle());
+        Index idx;
+        idx.tree_ = j.at("tree").get<std::string>();
+        for (const auto& f : j.at("files"))
+            idx.files_.push_back(f.at("path").get<std::string>());
+        idx.stamps_ = j.at("files");
+        const auto& c = j.at("columns");
+        idx.cols_ = {c.at(0).get<std::string>(), c.at(1).get<std::string>(), c.at(2).get<std::string>()};
+
+        Int_t run = 0, sub = 0, evt = 0;
+        UInt_t fid = 0;
+        Long64_t entry = 0;
+        t->SetBranchAddress("run", &run);
+        t->SetBranchAddress("sub", &sub);
+        t->SetBranchAddress("evt", &evt);
+        t->SetBranchAddress("file", &fid);
+        t->SetBranchAddress("entry", &entry);
+        const Long64_t n = t->GetEntries();
+        idx.records_.reserve(static_cast<std::size_t>(n));
+        for (Long64_t i = 0; i < n; ++i) {
+            t->GetEntry(i);
+            if (fid >= idx.files_.size())
+                throw std::runtime_error("event index: corrupt file id in " + path);
+            idx.records_.push_back({{run, sub, evt}, {fid, entry}});
+        }
+        t->ResetBranchAddresses();
+        return idx;
+    }
+
+    void save(const std::string& path) const {
+        const auto parent = std::filesystem::path(path).parent_path();
+        if (!parent.empty())
+            std::filesystem::create_directories(parent);
+        const auto tmp = path + ".tmp";
+        {
+            std::unique_ptr<TFile> file{TFile::Open(tmp.c_str(), "RECREATE")};
+            if (!file || file->IsZombie())
+                throw std::runtime_error("event index: cannot write " + tmp);
+            TTree t(index_tree_name, "(run, sub, evt) -> (file, entry)");
+            Int_t run = 0, sub = 0, evt = 0;
+            UInt_t fid = 0;
+            Long64_t entry = 0;
+            t.Branch("run", &run);
+            t.Branch("sub", &sub);
+            t.Branch("evt", &evt);
+            t.Branch("file", &fid);
+            t.Branch("entry", &entry);
+            for (const auto& r : records_) {
+                run = r.key.run;
+                sub = r.key.sub;
+                evt = r.key.evt;
+                fid = static_cast<UInt_t>(r.loc.file);
+                entry = r.loc.entry;
+                t.Fill();
+            }
+            const nlohmann::json meta{{"tree", tree_},
+                                      {"files", files::stamp(files_)},
+                                      {"columns", {cols_.run, cols_.sub, cols_.evt}}};
+            TNamed named(index_meta_name, meta.dump().c_str());
+            t.Write();
+            named.Write();
+        }
+        std::filesystem::rename(tmp, path);
+    }
+
+    // Reuses the index at `path` while it still describes the same inputs,
+    // otherwise rebuilds it and writes it back. An empty path keeps it in memory.
+    static Index open(const std::string& path, const std::string& tree, const std::vector<std::string>& files,
+                      const Columns& cols = {}) {
+        if (!path.empty() && std::filesystem::exists(path)) {
+            auto idx = load(path);
+            if (idx.tree_ == tree && idx.cols_.run == cols.run && idx.cols_.sub == cols.sub &&
+                idx.cols_.evt == cols.evt && idx.stamps_ == files::stamp(files))
+                return idx;
+        }
+        auto idx = build(tree, files, cols);
+        if (!path.empty())
+            idx.save(path);
+        return idx;
+    }
+
+    const std::string& tree() const { return tree_; }
+    const std::vector<std::string>& files() const { return files_; }
+    std::size_t size() const { return records_.size(); }
+
+    // First entry holding the key; see locate() for keys held by several entries.
+    std::optional<Location> find(const Key& k) const {
+        auto it = std::lower_bound(records_.begin(), records_.end(), k,
+                                   [](const Record& r, const Key& key) { return r.key < key; });
+        if (it == records_.end() || !(it->key == k))
+            return std::nullopt;
+        return it->loc;
+    }
+
+    // Keys held by more than one entry.
+    std::vector<Key> duplicates() const {
+        std::vector<Key> out;
+        for (std::size_t i = 1; i < records_.size(); ++i) {
+            if (records_[i].key == records_[i - 1].key && (out.empty() || !(out.back() == records_[i].key)))
+                out.push_back(records_[i].key);
+        }
+        return out;
+    }
+
+    // Every entry holding one of the requested keys, with the keys that are
+    // missing from the index or held by several entries reported separately.
+    Lookup locate(std::vector<Key> keys) const {
+        std::sort(keys.begin(), keys.end());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+        Lookup out;
+        out.found.reserve(keys.size());
+        for (const auto& k : keys) {
+            const auto range = std::equal_range(records_.begin(), records_.end(), Record{k, {}},
+                                                [](const Record& a, const Record& b) { return a.key < b.key; });
+            if (range.first == range.second) {
+                out.missing.push_back(k);
+                continue;
+            }
+            if (std::distance(range.first, range.second) > 1)
+                out.duplicated.push_back(k);
+            for (auto it = range.first; it != range.second; ++it)
+                out.found.push_back(it->loc);
+        }
+        std::sort(out.found.begin(), out.found.end(), [](const Location& a, const Location& b) {
+            return std::tie(a.file, a.entry) < std::tie(b.file, b.entry);
+        });
+        return out;
+    }
+
+    // A chain over the indexed files restricted to the located events; the
+    // entry list is owned by the chain.
+    std::shared_ptr<TChain> chain(const Lookup& found) const {
+        auto ch = std::make_shared<TChain>(tree_.c_str());
+        for (const auto& f : files_)
+            ch->Add(f.c_str());
+        auto* list = new TEntryList("event_index_selection", "indexed events");
+        list->SetDirectory(nullptr);
+        list->SetBit(kCanDelete);
+        for (const auto& loc : found.found)
+            list->Enter(loc.entry, tree_.c_str(), files_[loc.file].c_str());
+        ch->SetEntryList(list, "ne");
+        return ch;
+    }
+
+    std::shared_ptr<TChain> chain(const std::vector<Key>& keys) const { return chain(locate(keys)); }
+
+  private:
+    struct Record {
+        Key key;
+        Location loc;
+    };
+
+    static TLeaf* leaf(TTree& t, const std::string& name, const std::string& fallback) {
+        for (const auto& n : {name, fallback}) {
+            if (auto* l = t.GetLeaf(n.c_str())) {
+                t.SetBranchStatus(l->GetBranch()->GetName(), true);
+                return l;
+            }
+        }
+        throw std::runtime_error("event index: no branch " + name + " in tree " + t.GetName());
+    }
+
+    void sort() {
+        std::stable_sort(records_.begin(), records_.end(),
+                         [](const Record& a, const Record& b) { return a.key < b.key; });
+    }
+
+    std::string tree_;
+    std::vector<std::string> files_;
+    nlohmann::json stamps_;
+    Columns cols_;
+    std::vector<Record> records_;
+};
+
+}
+}
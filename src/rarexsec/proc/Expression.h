@@ -0,0 +1,397 @@
+#pragma once
+#include <ROOT/RDataFrame.hxx>
+#include <TError.h>
+#include <TInterpreter.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "rarexsec/proc/ColumnTrace.h"
+#include "rarexsec/proc/Profile.h"
+
+namespace rarexsec {
+namespace expr {
+
+// Scalar column types an expression argument may have; anything else is left to RDF's own jitting.
+enum class Kind { Float,
+                  Double,
+                  Int,
+                  UInt,
+                  Bool,
+                  Long64,
+                  ULong64,
+                  Short,
+                  UShort,
+                  Char,
+                  UChar,
+                  Other };
+
+inline Kind kind_of(const std::string& type) {
+    static const std::unordered_map<std::string, Kind> kinds{
+        {"float", Kind::Float}, {"Float_t", Kind::Float},
+        {"double", Kind::Double}, {"Double_t", Kind::Double},
+        {"int", Kind::Int}, {"Int_t", Kind::Int}, {"std::int32_t", Kind::Int},
+        {"unsigned int", Kind::UInt}, {"UInt_t", Kind::UInt}, {"std::uint32_t", Kind::UInt},
+        {"bool", Kind::Bool}, {"Bool_t", Kind::Bool},
+        {"Long64_t", Kind::Long64}, {"long", Kind::Long64}, {"long long", Kind::Long64}, {"std::int64_t", Kind::Long64},
+        {"ULong64_t", Kind::ULong64}, {"unsigned long", Kind::ULong64}, {"unsigned long long", Kind::ULong64},
+        {"std::uint64_t", Kind::ULong64},
+        {"short", Kind::Short}, {"Short_t", Kind::Short}, {"std::int16_t", Kind::Short},
+        {"unsigned short", Kind::UShort}, {"UShort_t", Kind::UShort}, {"std::uint16_t", Kind::UShort},
+        {"char", Kind::Char}, {"Char_t", Kind::Char}, {"std::int8_t", Kind::Char},
+        {"unsigned char", Kind::UChar}, {"UChar_t", Kind::UChar}, {"std::uint8_t", Kind::UChar},
+    };
+    auto it = kinds.find(type);
+    return it == kinds.end() ? Kind::Other : it->second;
+}
+
+inline const char* cpp_type(Kind k) {
+    switch (k) {
+    case Kind::Float:
+        return "float";
+    case Kind::Double:
+        return "double";
+    case Kind::Int:
+        return "int";
+    case Kind::UInt:
+        return "unsigned int";
+    case Kind::Bool:
+        return "bool";
+    case Kind::Long64:
+        return "long long";
+    case Kind::ULong64:
+        return "unsigned long long";
+    case Kind::Short:
+        return "short";
+    case Kind::UShort:
+        return "unsigned short";
+    case Kind::Char:
+        return "char";
+    case Kind::UChar:
+        return "unsigned char";
+    case Kind::Other:
+        break;
+    }
+    return nullptr;
+}
+
+using Function = double (*)(const double*);
+
+// A compiled expression and the type its expression naturally evaluates to.
+struct Compiled {
+    Function fn = nullptr;
+    Kind result = Kind::Other;
+};
+
+// Compiles each distinct (expression, argument types) pair once into a free function
+// double f(const double* args) and hands out its address, so booking the same
+// expression on many frames costs one Cling compilation instead of one per node.
+// The natural result type is recorded so defines keep the column type RDF's own
+// jitting would give. Compilation runs with ROOT errors silenced; an expression
+// that does not compile is remembered as such and left to RDF.
+// RAREXSEC_EXPR_REGISTRY=0 disables it and leaves every expression to RDF.
+class Registry {
+  public:
+    static Registry& instance() {
+        static Registry r;
+        return r;
+    }
+
+    bool enabled() const { return enabled_; }
+
+    Compiled get(const std::string& expr, const std::vector<std::string>& cols, const std::vector<Kind>& kinds) {
+        std::string key = expr;
+        for (std::size_t i = 0; i < cols.size(); ++i)
+            key += std::string("\n") + cols[i] + ":" + cpp_type(kinds[i]);
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = cache_.find(key);
+        if (it != cache_.end())
+            return it->second;
+        const Compiled c = compile(expr, cols, kinds);
+        cache_.emplace(std::move(key), c);
+        return c;
+    }
+
+    std::size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return cache_.size();
+    }
+
+  private:
+    struct Quiet {
+        Int_t level = gErrorIgnoreLevel;
+        Quiet() { gErrorIgnoreLevel = kFatal; }
+        ~Quiet() { gErrorIgnoreLevel = level; }
+    };
+
+    Registry() {
+        const char* v = std::getenv("RAREXSEC_EXPR_REGISTRY");
+        enabled_ = !(v && std::string(v) == "0");
+    }
+
+    // rarexsec_expr::kind<T>() maps a type onto the Kind enumerators, offset by one
+    // so that a failed Calc (which returns 0) is not mistaken for Kind::Float.
+    bool declare_kind() {
+        if (kind_declared_)
+            return true;
+        std::string code = "#include <type_traits>\nnamespace rarexsec_expr { template <class T> constexpr int kind() {\n"
+                           "  using U = typename std::decay<T>::type;\n  return ";
+        for (int k = 0; k < static_cast<int>(Kind::Other); ++k)
+            code += "std::is_same<U, " + std::string(cpp_type(static_cast<Kind>(k))) + ">::value ? " +
+                    std::to_string(k + 1) + " : ";
+        code += std::to_string(static_cast<int>(Kind::Other) + 1) + ";\n}\n}\n";
+        kind_declared_ = gInterpreter->Declare(code.c_str());
+        return kind_declared_;
+    }
+
+    Compiled compile(const std::string& expr, const std::vector<std::string>& cols, const std::vector<Kind>& kinds) {
+        Quiet quiet;
+        if (!declare_kind())
+            return {};
+        const std::string id = std::to_string(cache_.size());
+        std::string code = "namespace rarexsec_expr { inline auto r" + id + "(const double* rx_args_) {\n";
+        for (std::size_t i = 0; i < cols.size(); ++i) {
+            const std::string type = cpp_type(kinds[i]);
+            code += "  const " + type + " " + cols[i] + " = static_cast<" + type + ">(rx_args_[" + std::to_string(i) + "]);\n";
+        }
+        code += "  return " + expr + ";\n}\n";
+        code += "double f" + id + "(const double* rx_args_) { return static_cast<double>(r" + id + "(rx_args_)); }\n}\n";
+        profile::jit(expr);
+        if (!gInterpreter->Declare(code.c_str()))
+            return {};
+        const auto addr = gInterpreter->Calc(("(long long)&rarexsec_expr::f" + id + ";").c_str());
+        if (!addr)
+            return {};
+        const auto kind = gInterpreter->Calc(("rarexsec_expr::kind<decltype(rarexsec_expr::r" + id + "(nullptr))>();").c_str());
+        Compiled c;
+        c.fn = reinterpret_cast<Function>(static_cast<std::uintptr_t>(addr));
+        c.result = kind > 0 && kind <= static_cast<long>(Kind::Other) ? static_cast<Kind>(kind - 1) : Kind::Other;
+        return c;
+    }
+
+    bool enabled_ = true;
+    bool kind_declared_ = false;
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, Compiled> cache_;
+};
+
+inline std::string arg_column(const std::string& col) { return "_rx_d_" + col; }
+
+inline ROOT::RDF::RNode as_double(ROOT::RDF::RNode node, const std::string& col, Kind k) {
+    const auto out = arg_column(col);
+    if (node.HasColumn(out))
+        return node;
+    switch (k) {
+    case Kind::Float:
+        return node.Define(out, [](float x) { return static_cast<double>(x); }, {col});
+    case Kind::Double:
+        return node.Define(out, [](double x) { return x; }, {col});
+    case Kind::Int:
+        return node.Define(out, [](int x) { return static_cast<double>(x); }, {col});
+    case Kind::UInt:
+        return node.Define(out, [](unsigned int x) { return static_cast<double>(x); }, {col});
+    case Kind::Bool:
+        return node.Define(out, [](bool x) { return x ? 1.0 : 0.0; }, {col});
+    case Kind::Short:
+        return node.Define(out, [](short x) { return static_cast<double>(x); }, {col});
+    case Kind::UShort:
+        return node.Define(out, [](unsigned short x) { return static_cast<double>(x); }, {col});
+    case Kind::Char:
+        return node.Define(out, [](char x) { return static_cast<double>(x); }, {col});
+    case Kind::UChar:
+        return node.Define(out, [](unsigned char x) { return static_cast<double>(x); }, {col});
+    default:
+        break;
+    }
+    throw std::invalid_argument("expr: column " + col + " cannot be passed exactly as a double");
+}
+
+inline constexpr std::size_t max_args = 8;
+
+template <class Out, std::size_t... I>
+inline ROOT::RDF::RNode define_call(ROOT::RDF::RNode node, const std::string& name, Function fn,
+                                    const std::vector<std::string>& args, std::index_sequence<I...>) {
+    return node.Define(
+        name,
+        [fn](decltype(static_cast<double>(I))... a) {
+            const double v[] = {a..., 0.0};
+            return static_cast<Out>(fn(v));
+        },
+        args);
+}
+
+template <class Out>
+inline ROOT::RDF::RNode define_call(ROOT::RDF::RNode node, const std::string& name, Function fn,
+                                    const std::vector<std::string>& args) {
+    switch (args.size()) {
+    case 0:
+        return define_call<Out>(node, name, fn, args, std::make_index_sequence<0>{});
+    case 1:
+        return define_call<Out>(node, name, fn, args, std::make_index_sequence<1>{});
+    case 2:
+        return define_call<Out>(node, name, fn, args, std::make_index_sequence<2>{});
+    case 3:
+        return define_call<Out>(node, name, fn, args, std::make_index_sequence<3>{});
+    case 4:
+        return define_call<Out>(node, name, fn, args, std::make_index_sequence<4>{});
+    case 5:
+        return define_call<Out>(node, name, fn, args, std::make_index_sequence<5>{});
+    case 6:
+        return define_call<Out>(node, name, fn, args, std::make_index_sequence<6>{});
+    case 7:
+        return define_call<Out>(node, name, fn, args, std::make_index_sequence<7>{});
+    case 8:
+        return define_call<Out>(node, name, fn, args, std::make_index_sequence<8>{});
+    }
+    throw std::invalid_argument("expr: too many columns");
+}
+
+// Binds an expression to a node: the compiled function and its argument columns
+// (already converted to double), or nothing when RDF has to jit it itself.
+struct Binding {
+    ROOT::RDF::RNode node;
+    Function fn = nullptr;
+    std::vector<std::string> args;
+    Kind result = Kind::Other;
+};
+
+// Argument types that survive the trip through double; 64-bit integers such as
+// event numbers do not, so expressions reading them stay on RDF's jit path.
+inline bool exact_in_double(Kind k) { return k != Kind::Other && k != Kind::Long64 && k != Kind::ULong64; }
+
+inline Binding bind(ROOT::RDF::RNode node, const std::string& expr) {
+    Binding b{node, nullptr, {}};
+    auto& reg = Registry::instance();
+    if (!reg.enabled() || expr.empty())
+        return b;
+    std::vector<std::string> cols;
+    std::unordered_set<std::string> seen;
+    for (const auto& id : trace::identifiers(expr)) {
+        if (seen.insert(id).second && node.HasColumn(id))
+            cols.push_back(id);
+    }
+    if (cols.size() > max_args)
+        return b;
+    std::vector<Kind> kinds;
+    kinds.reserve(cols.size());
+    for (const auto& c : cols) {
+        kinds.push_back(kind_of(node.GetColumnType(c)));
+        if (!exact_in_double(kinds.back()))
+            return b;
+    }
+    const Compiled c = reg.get(expr, cols, kinds);
+    if (!c.fn)
+        return b;
+    for (std::size_t i = 0; i < cols.size(); ++i) {
+        b.node = as_double(b.node, cols[i], kinds[i]);
+        b.args.push_back(arg_column(cols[i]));
+    }
+    b.fn = c.fn;
+    b.result = c.result;
+    return b;
+}
+
+// Defines a column of the expression's natural type; 64-bit and non-scalar
+// results are left to RDF.
+inline ROOT::RDF::RNode define(ROOT::RDF::RNode node, const std::string& name, const std::string& expr) {
+    trace::use_expr(expr);
+    auto b = bind(node, expr);
+    if (b.fn) {
+        switch (b.result) {
+        case Kind::Float:
+            return define_call<float>(b.node, name, b.fn, b.args);
+        case Kind::Double:
+            return define_call<double>(b.node, name, b.fn, b.args);
+        case Kind::Int:
+            return define_call<int>(b.node, name, b.fn, b.args);
+        case Kind::UInt:
+            return define_call<unsigned int>(b.node, name, b.fn, b.args);
+        case Kind::Bool:
+            return define_call<bool>(b.node, name, b.fn, b.args);
+        case Kind::Short:
+            return define_call<short>(b.node, name, b.fn, b.args);
+        case Kind::UShort:
+            return define_call<unsigned short>(b.node, name, b.fn, b.args);
+        case Kind::Char:
+            return define_call<char>(b.node, name, b.fn, b.args);
+        case Kind::UChar:
+            return define_call<unsigned char>(b.node, name, b.fn, b.args);
+        default:
+            break;
+        }
+    }
+    profile::jit(expr);
+    return node.Define(name, expr);
+}
+
+inline ROOT::RDF::RNode filter(ROOT::RDF::RNode node, const std::string& expr, const std::string& name = "") {
+    trace::use_expr(expr);
+    auto b = bind(node, expr);
+    if (!b.fn) {
+        profile::jit(expr);
+        return node.Filter(expr, name);
+    }
+    static unsigned counter = 0;
+    static std::mutex mutex;
+    std::string col;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        col = "_rx_filter_" + std::to_string(counter++);
+    }
+    return define_call<bool>(b.node, col, b.fn, b.args).Filter([](bool pass) { return pass; }, {col}, name);
+}
+
+template <class V>
+inline ROOT::RDF::RResultPtr<TH1D> histo1d_typed(ROOT::RDF::RNode node, const ROOT::RDF::TH1DModel& model,
+                                                 const std::string& var, const std::string& weight, Kind wk) {
+    switch (wk) {
+    case Kind::Float:
+        return node.Histo1D<V, float>(model, var, weight);
+    case Kind::Double:
+        return node.Histo1D<V, double>(model, var, weight);
+    case Kind::Int:
+        return node.Histo1D<V, int>(model, var, weight);
+    default:
+        return node.Histo1D(model, var, weight);
+    }
+}
+
+// Histo1D with the column types resolved here, so booking does not jit an action
+// for the common float/double/int cases.
+inline ROOT::RDF::RResultPtr<TH1D> histo1d(ROOT::RDF::RNode node, const ROOT::RDF::TH1DModel& model,
+                                           const std::string& var, const std::string& weight = "") {
+    const Kind vk = kind_of(node.GetColumnType(var));
+    if (weight.empty()) {
+        switch (vk) {
+        case Kind::Float:
+            return node.Histo1D<float>(model, var);
+        case Kind::Double:
+            return node.Histo1D<double>(model, var);
+        case Kind::Int:
+            return node.Histo1D<int>(model, var);
+        default:
+            return node.Histo1D(model, var);
+        }
+    }
+    const Kind wk = kind_of(node.GetColumnType(weight));
+    switch (vk) {
+    case Kind::Float:
+        return histo1d_typed<float>(node, model, var, weight, wk);
+    case Kind::Double:
+        return histo1d_typed<double>(node, model, var, weight, wk);
+    case Kind::Int:
+        return histo1d_typed<int>(node, model, var, weight, wk);
+    default:
+        return node.Histo1D(model, var, weight);
+    }
+}
+
+}
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <TSystem.h>
+#include <nlohmann/json.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace rarexsec {
+namespace files {
+
+// Size and mtime of an input file, used to tell whether results derived from it
+// are still current. Local paths are read with std::filesystem, URLs (root://,
+// http://, ...) through TSystem so the matching plugin stats the remote file.
+// A file that cannot be stat-ed gets a stamp that never compares equal, forcing
+// whatever depends on it to be rebuilt rather than trusted.
+inline nlohmann::json stamp(const std::string& path) {
+    const bool url = path.find("://") != std::string::npos && path.rfind("file://", 0) != 0;
+    if (!url) {
+        const std::string local = path.rfind("file://", 0) == 0 ? path.substr(7) : path;
+        std::error_code ec;
+        const auto size = std::filesystem::file_size(local, ec);
+        if (!ec) {
+            const auto mtime = std::filesystem::last_write_time(local, ec);
+            if (!ec)
+                return {{"path", path},
+                        {"size", static_cast<long long>(size)},
+                        {"mtime", static_cast<long long>(mtime.time_since_epoch().count())}};
+        }
+    } else {
+        FileStat_t st;
+        if (gSystem->GetPathInfo(path.c_str(), st) == 0)
+            return {{"path", path}, {"size", static_cast<long long>(st.fSize)}, {"mtime", static_cast<long long>(st.fMtime)}};
+    }
+    static std::atomic<unsigned long long> counter{0};
+    const auto now = std::chrono::system_clock::now().time_since_epoch().count();
+    return {{"path", path}, {"size", -1}, {"mtime", -1}, {"unstamped", std::to_string(now) + "." + std::to_string(counter++)}};
+}
+
+inline nlohmann::json stamp(const std::vector<std::string>& paths) {
+    nlohmann::json out = nlohmann::json::array();
+    for (const auto& p : paths)
+        out.push_back(stamp(p));
+    return out;
+}
+
+}
+}
@@ -1,6 +1,8 @@
 #pragma once
 
-#include "rarexsec/DataModel.h"
+#include "rarexsec/proc/DataModel.h"
+#include "rarexsec/proc/Expression.h"
+#include "rarexsec/proc/Progress.h"
 #include <TH1D.h>
 #include <string>
 #include <string_view>
@@ -11,7 +13,8 @@ namespace rarexsec::book {
 inline ROOT::RDF::RResultPtr<TH1D>
 H1(const Frame& f, const TH1D& model, std::string_view col,
    std::string_view wcol = "w_nominal") {
-   return f.node.Histo1D(model, std::string(col), std::string(wcol));
+    progress::expect(f);
+    return expr::histo1d(f.rnode(), model, std::string(col), std::string(wcol));
 }
 
 inline std::unordered_map<std::string, ROOT::RDF::RResultPtr<TH1D>>
@@ -0,0 +1,353 @@
+#pragma once
+#include <ROOT/RDataFrame.hxx>
+#include <TH1.h>
+#include <TH1D.h>
+#include <TMatrixDSym.h>
+#include <TROOT.h>
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace rarexsec {
+namespace memory {
+
+inline constexpr const char* booked = "booked_results";
+inline constexpr const char* clones = "histogram_clones";
+inline constexpr const char* covariances = "covariances";
+inline constexpr const char* graphs = "rdf_graphs";
+
+inline long long hist_bytes(long long ncells) {
+    return static_cast<long long>(sizeof(TH1D)) + 2 * ncells * static_cast<long long>(sizeof(double));
+}
+
+inline long long bytes(const TH1& h) {
+    return static_cast<long long>(sizeof(TH1D)) +
+           (static_cast<long long>(h.GetNcells()) + h.GetSumw2N()) * static_cast<long long>(sizeof(double));
+}
+
+inline long long bytes(const ROOT::RDF::TH1DModel& m) { return hist_bytes(m.fNbinsX + 2); }
+
+inline long long matrix_bytes(long long n) {
+    return static_cast<long long>(sizeof(TMatrixDSym)) + n * n * static_cast<long long>(sizeof(double));
+}
+
+inline long long bytes(const TMatrixDSym& m) { return matrix_bytes(m.GetNrows()); }
+
+// Resident and peak resident set size of the process in bytes, from /proc/self/status.
+inline std::pair<long long, long long> rss() {
+    std::ifstream in("/proc/self/status");
+    long long now = 0, peak = 0;
+    for (std::string line; std::getline(in, line);) {
+        std::istringstream ss(line);
+        std::string key;
+        long long kb = 0;
+        ss >> key >> kb;
+        if (key == "VmRSS:")
+            now = kb * 1024;
+        else if (key == "VmHWM:")
+            peak = kb * 1024;
+    }
+    return {now, peak};
+}
+
+// Parses sizes such as "2048", "512M", "4G" or "1.5GiB" (binary units).
+inline long long parse_size(const std::string& text) {
+    std::size_t pos = 0;
+    double v = 0.0;
+    try {
+        v = std::stod(text, &pos);
+    } catch (const std::exception&) {
+        throw std::invalid_argument("bad memory size " + text);
+    }
+    std::string unit;
+    for (char c : text.substr(pos))
+        if (!std::isspace(static_cast<unsigned char>(c)))
+            unit += static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+    if (unit.size() > 1 && unit.back() == 'B')
+        unit.pop_back();
+    if (unit.size() > 1 && unit.back() == 'I')
+        unit.pop_back();
+    static const std::map<std::string, double> scale{
+        {"", 1.0}, {"K", 1024.0}, {"M", 1024.0 * 1024.0}, {"G", 1024.0 * 1024.0 * 1024.0},
+        {"T", 1024.0 * 1024.0 * 1024.0 * 1024.0}};
+    auto it = scale.find(unit);
+    if (it == scale.end() || v < 0.0)
+        throw std::invalid_argument("bad memory size " + text);
+    return static_cast<long long>(v * it->second);
+}
+
+inline std::string human(long long b) {
+    static const char* units[] = {"B", "KiB", "MiB", "GiB", "TiB"};
+    double v = static_cast<double>(b);
+    int u = 0;
+    while (v >= 1024.0 && u < 4) {
+        v /= 1024.0;
+        ++u;
+    }
+    std::ostringstream ss;
+    ss.precision(u ? 1 : 0);
+    ss << std::fixed << v << " " << units[u];
+    return ss.str();
+}
+
+// Accounts the bytes held by booked results, histogram clones, covariance matrices
+// and RDF graphs, per component and per stage, next to the process RSS.
+// Enabled with RAREXSEC_MEMORY=<path> and/or RAREXSEC_MEMORY_BUDGET=<size>.
+// The report is rewritten at every stage boundary, so after an OOM kill it still
+// names the stage that was running. Requests that would take the process past the
+// budget are reported on stderr once per label.
+class Tracker {
+  public:
+    static Tracker& instance() {
+        static Tracker t;
+        return t;
+    }
+
+    bool enabled() const { return enabled_; }
+    long long budget() const { return budget_; }
+
+    // Returns false (and warns) when bytes more would exceed the budget.
+    bool check(const std::string& label, long long bytes) {
+        if (!enabled_ || budget_ <= 0 || bytes <= 0)
+            return true;
+        const long long now = rss().first;
+        std::lock_guard<std::mutex> lock(mutex_);
+        const long long projected = std::max(now, total_) + bytes;
+        if (projected <= budget_)
+            return true;
+        if (warned_.insert(label).second) {
+            std::ostringstream msg;
+            msg << "rarexsec: " << label << " needs " << human(bytes) << " on top of " << human(std::max(now, total_))
+                << ", over the memory budget of " << human(budget_);
+            if (!stages_.empty())
+                msg << " (stage " << stage_path() << ")";
+            std::cerr << msg.str() << std::endl;
+            warnings_.push_back({{"label", label}, {"bytes", bytes}, {"rss", now}, {"tracked", total_},
+                                 {"stage", stage_path()}});
+        }
+        return false;
+    }
+
+    void add(const std::string& component, long long bytes) {
+        if (!enabled_ || bytes == 0)
+            return;
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto& c = components_[component];
+        c.current += bytes;
+        c.peak = std::max(c.peak, c.current);
+        total_ += bytes;
+        peak_ = std::max(peak_, total_);
+        for (auto& s : stages_)
+            s.peak = std::max(s.peak, total_);
+    }
+
+    void release(const std::string& component, long long bytes) { add(component, -bytes); }
+
+    void begin(const std::string& label) {
+        if (!enabled_)
+            return;
+        const auto r = rss();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stages_.push_back({label, r.first, total_});
+        }
+        flush();
+    }
+
+    void end() {
+        if (!enabled_)
+            return;
+        const auto [now, peak] = rss();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stages_.empty())
+                return;
+            const std::string path = stage_path();
+            const auto s = stages_.back();
+            stages_.pop_back();
+            done_.push_back({{"stage", path},
+                             {"rss_before", s.rss},
+                             {"rss_after", now},
+                             {"rss_peak", peak},
+                             {"tracked_peak", s.peak}});
+        }
+        flush();
+    }
+
+    nlohmann::json report() const {
+        const auto [now, peak] = rss();
+        std::lock_guard<std::mutex> lock(mutex_);
+        nlohmann::json comps = nlohmann::json::object();
+        for (const auto& [name, c] : components_)
+            comps[name] = {{"current", c.current}, {"peak", c.peak}};
+        return {{"budget", budget_},
+                {"rss", now},
+                {"rss_peak", peak},
+                {"tracked", total_},
+                {"tracked_peak", peak_},
+                {"components", comps},
+                {"running", stage_path()},
+                {"stages", done_},
+                {"warnings", warnings_}};
+    }
+
+    void flush() const {
+        if (path_.empty())
+            return;
+        const auto tmp = path_ + ".tmp";
+        {
+            std::ofstream out(tmp);
+            if (!out)
+                return;
+            out << report().dump(2) << "\n";
+        }
+        std::rename(tmp.c_str(), path_.c_str());
+    }
+
+    ~Tracker() {
+        try {
+            flush();
+        } catch (...) {
+        }
+    }
+
+  private:
+    struct Component {
+        long long current = 0;
+        long long peak = 0;
+    };
+
+    struct Stage {
+        std::string label;
+        long long rss = 0;
+        long long peak = 0;
+    };
+
+    Tracker() {
+        if (const char* p = std::getenv("RAREXSEC_MEMORY"); p && *p)
+            path_ = p;
+        if (const char* b = std::getenv("RAREXSEC_MEMORY_BUDGET"); b && *b)
+            budget_ = parse_size(b);
+        enabled_ = !path_.empty() || budget_ > 0;
+    }
+
+    // Caller holds mutex_.
+    std::string stage_path() const {
+        std::string out;
+        for (const auto& s : stages_)
+            out += (out.empty() ? "" : "/") + s.label;
+        return out;
+    }
+
+    bool enabled_ = false;
+    std::string path_;
+    long long budget_ = 0;
+    mutable std::mutex mutex_;
+    std::map<std::string, Component> components_;
+    long long total_ = 0;
+    long long peak_ = 0;
+    std::vector<Stage> stages_;
+    std::vector<nlohmann::json> done_;
+    std::vector<nlohmann::json> warnings_;
+    std::set<std::string> warned_;
+};
+
+inline bool enabled() { return Tracker::instance().enabled(); }
+
+// Holds bytes against a component for its lifetime, checking the budget first.
+class Lease {
+  public:
+    Lease() = default;
+    Lease(std::string component, long long bytes, const std::string& label) : component_(std::move(component)) {
+        auto& t = Tracker::instance();
+        if (!t.enabled())
+            return;
+        t.check(label, bytes);
+        t.add(component_, bytes);
+        bytes_ = bytes;
+    }
+
+    ~Lease() {
+        if (bytes_)
+            Tracker::instance().release(component_, bytes_);
+    }
+
+    Lease(Lease&& o) noexcept : component_(std::move(o.component_)), bytes_(std::exchange(o.bytes_, 0)) {}
+    Lease& operator=(Lease&& o) noexcept {
+        if (this != &o) {
+            if (bytes_)
+                Tracker::instance().release(component_, bytes_);
+            component_ = std::move(o.component_);
+            bytes_ = std::exchange(o.bytes_, 0);
+        }
+        return *this;
+    }
+    Lease(const Lease&) = delete;
+    Lease& operator=(const Lease&) = delete;
+
+  private:
+    std::string component_;
+    long long bytes_ = 0;
+};
+
+// Marks a named stage in the report; stages nest.
+class Stage {
+  public:
+    explicit Stage(const std::string& label) {
+        active_ = enabled();
+        if (active_)
+            Tracker::instance().begin(label);
+    }
+    ~Stage() {
+        if (active_)
+            Tracker::instance().end();
+    }
+    Stage(const Stage&) = delete;
+    Stage& operator=(const Stage&) = delete;
+
+  private:
+    bool active_ = false;
+};
+
+// Records the RSS growth over its lifetime against a component, e.g. building RDF graphs.
+class Growth {
+  public:
+    explicit Growth(std::string component) : component_(std::move(component)) {
+        if (enabled())
+            before_ = rss().first;
+    }
+    ~Growth() {
+        if (before_ > 0)
+            Tracker::instance().add(component_, std::max(0LL, rss().first - before_));
+    }
+    Growth(const Growth&) = delete;
+    Growth& operator=(const Growth&) = delete;
+
+  private:
+    std::string component_;
+    long long before_ = 0;
+};
+
+// Booked Histo1D results hold one histogram per processing slot until they are released.
+inline Lease book(const ROOT::RDF::TH1DModel& model, std::size_t count, const std::string& label) {
+    if (!enabled())
+        return {};
+    const long long slots = ROOT::IsImplicitMTEnabled() ? std::max(1u, ROOT::GetThreadPoolSize()) : 1;
+    return Lease(booked, static_cast<long long>(count) * slots * bytes(model), label);
+}
+
+}
+}
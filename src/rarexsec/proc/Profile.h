@@ -0,0 +1,315 @@
+#pragma once
+#include <ROOT/RDataFrame.hxx>
+#include <TFile.h>
+#include <nlohmann/json.hpp>
+
+#include "rarexsec/proc/DataModel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace rarexsec {
+namespace profile {
+
+// Per-job timing report for the event loops the library runs.
+// Enabled with RAREXSEC_PROFILE=<path>; the JSON report is written to <path> at exit.
+// Hub frames count processed entries per slot, selection filters are named so their
+// pass rates can be read from Report(), and every place that materialises results
+// opens a Scope recording wall time, time to first entry, bytes read and jitted
+// expressions for the loops it triggers.
+class Profiler {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    static Profiler& instance() {
+        static Profiler p;
+        return p;
+    }
+
+    bool enabled() const { return !path_.empty(); }
+
+    static long long now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+    }
+
+    // Counts the entries a frame feeds to its event loops; the returned node replaces the root.
+    ROOT::RDF::RNode attach(ROOT::RDF::RNode node, const std::string& label) {
+        if (!enabled())
+            return node;
+        auto g = std::make_shared<Graph>();
+        g->label = label;
+        g->slots = std::vector<Slot>(std::max(1u, node.GetNSlots()));
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            graphs_.push_back(g);
+        }
+        return node.Filter([g](unsigned slot) {
+            auto& s = g->slots[slot % g->slots.size()];
+            if (s.entries.fetch_add(1, std::memory_order_relaxed) == 0) {
+                long long expected = 0;
+                g->first.compare_exchange_strong(expected, now(), std::memory_order_relaxed);
+            }
+            return true;
+        },
+                           {"rdfslot_"});
+    }
+
+    // The report holds the graph it was booked on, so only weak handles to the
+    // frames the node derives from are kept next to it: once all of them are gone
+    // the graph can no longer run and the report is released.
+    void cuts(ROOT::RDF::RNode node, const std::string& label, std::vector<std::weak_ptr<ROOT::RDataFrame>> owners) {
+        if (!enabled())
+            return;
+        auto report = node.Report();
+        std::lock_guard<std::mutex> lock(mutex_);
+        reports_.push_back(Cuts{label, std::move(owners), std::move(report)});
+    }
+
+    // Only the outermost of nested scopes measures; returns whether this one is it.
+    bool enter() { return depth_.fetch_add(1, std::memory_order_relaxed) == 0; }
+
+    void leave() { depth_.fetch_sub(1, std::memory_order_relaxed); }
+
+    void jit(const std::string& expr) {
+        if (enabled() && !expr.empty())
+            jitted_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    unsigned long long jitted() const { return jitted_.load(std::memory_order_relaxed); }
+
+    // Entries counted outside any scope are kept out of the next scope's loops.
+    void reset() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& g : graphs_) {
+            for (auto& s : g->slots)
+                unscoped_ += s.entries.exchange(0, std::memory_order_relaxed);
+            g->first.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void record(const std::string& label, long long start, long long stop, Long64_t bytes,
+                unsigned long long jitted) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        nlohmann::json frames = nlohmann::json::array();
+        unsigned long long events = 0;
+        long long first = 0;
+        for (auto& g : graphs_) {
+            unsigned long long n = 0;
+            for (auto& s : g->slots)
+                n += s.entries.exchange(0, std::memory_order_relaxed);
+            const long long f = g->first.exchange(0, std::memory_order_relaxed);
+            if (n == 0)
+                continue;
+            events += n;
+            if (f > 0 && (first == 0 || f < first))
+                first = f;
+            frames.push_back({{"frame", g->label}, {"events", n}});
+        }
+        harvest();
+
+        const double wall = 1e-9 * static_cast<double>(stop - start);
+        const double setup = first > 0 ? 1e-9 * static_cast<double>(first - start) : wall;
+        loops_.push_back({{"label", label},
+                          {"wall_s", wall},
+                          {"to_first_entry_s", setup},
+                          {"loop_s", wall - setup},
+                          {"events", events},
+                          {"events_per_s", wall > 0.0 ? events / wall : 0.0},
+                          {"bytes_read", bytes},
+                          {"jitted", jitted},
+                          {"frames", frames}});
+    }
+
+    // Folds in the cut flows of every loop that has run; reports booked on graphs
+    // that never ran are released and only counted.
+    nlohmann::json report() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        harvest();
+        unrun_ += reports_.size();
+        reports_.clear();
+        nlohmann::json cuts = nlohmann::json::object();
+        for (const auto& [label, filters] : cuts_) {
+            auto& out = cuts[label] = nlohmann::json::array();
+            for (const auto& [name, count] : filters) {
+                const double eff = count.first > 0 ? static_cast<double>(count.second) / count.first : 0.0;
+                out.push_back({{"filter", name}, {"all", count.first}, {"pass", count.second}, {"eff", eff}});
+            }
+        }
+        return {{"loops", loops_},
+                {"cuts", cuts},
+                {"frames", graphs_.size()},
+                {"unscoped_events", unscoped_},
+                {"unrun_cut_reports", unrun_},
+                {"jitted", jitted()},
+                {"bytes_read", TFile::GetFileBytesRead()}};
+    }
+
+    void write(const std::string& path) {
+        std::ofstream out(path);
+        if (!out)
+            throw std::runtime_error("cannot write profile " + path);
+        out << report().dump(2) << "\n";
+    }
+
+    ~Profiler() {
+        if (path_.empty())
+            return;
+        try {
+            write(path_);
+        } catch (...) {
+        }
+    }
+
+  private:
+    struct alignas(64) Slot {
+        std::atomic<unsigned long long> entries{0};
+    };
+
+    struct Graph {
+        std::string label;
+        std::vector<Slot> slots;
+        std::atomic<long long> first{0};
+    };
+
+    struct Cuts {
+        std::string label;
+        std::vector<std::weak_ptr<ROOT::RDataFrame>> owners;
+        ROOT::RDF::RResultPtr<ROOT::RDF::RCutFlowReport> report;
+    };
+
+    Profiler() {
+        const char* p = std::getenv("RAREXSEC_PROFILE");
+        if (p && *p)
+            path_ = p;
+    }
+
+    // Folds finished cut-flow reports into cuts_ and releases them, along with the
+    // reports whose frames are all gone; caller holds mutex_.
+    void harvest() {
+        auto it = reports_.begin();
+        while (it != reports_.end()) {
+            if (!it->report.IsReady()) {
+                const bool orphaned = std::all_of(it->owners.begin(), it->owners.end(),
+                                                  [](const auto& o) { return o.expired(); });
+                if (orphaned) {
+                    ++unrun_;
+                    it = reports_.erase(it);
+                } else {
+                    ++it;
+                }
+                continue;
+            }
+            auto& filters = cuts_[it->label];
+            for (auto&& info : *it->report) {
+                auto& c = filters[info.GetName()];
+                c.first += info.GetAll();
+                c.second += info.GetPass();
+            }
+            it = reports_.erase(it);
+        }
+    }
+
+    std::string path_;
+    std::atomic<unsigned long long> jitted_{0};
+    std::atomic<int> depth_{0};
+    mutable std::mutex mutex_;
+    std::vector<std::shared_ptr<Graph>> graphs_;
+    std::vector<Cuts> reports_;
+    std::map<std::string, std::map<std::string, std::pair<unsigned long long, unsigned long long>>> cuts_;
+    std::vector<nlohmann::json> loops_;
+    unsigned long long unscoped_ = 0;
+    unsigned long long unrun_ = 0;
+};
+
+inline bool enabled() { return Profiler::instance().enabled(); }
+
+inline std::string label(const Entry& e) {
+    std::string kind;
+    switch (e.kind) {
+    case sample::origin::data:
+        kind = "data";
+        break;
+    case sample::origin::beam:
+        kind = "beam";
+        break;
+    case sample::origin::strangeness:
+        kind = "strangeness";
+        break;
+    case sample::origin::ext:
+        kind = "ext";
+        break;
+    case sample::origin::dirt:
+        kind = "dirt";
+        break;
+    default:
+        kind = "unknown";
+    }
+    return e.beamline + "/" + e.period + "/" + kind;
+}
+
+inline ROOT::RDF::RNode attach(ROOT::RDF::RNode node, const std::string& label) {
+    return Profiler::instance().attach(std::move(node), label);
+}
+
+// Books the cut flow of a node derived from one of the entry's frames.
+inline void cuts(ROOT::RDF::RNode node, const Entry& rec, const std::string& label) {
+    if (!enabled())
+        return;
+    std::vector<std::weak_ptr<ROOT::RDataFrame>> owners{rec.nominal.df};
+    for (const auto& kv : rec.detvars)
+        owners.push_back(kv.second.df);
+    Profiler::instance().cuts(std::move(node), label, std::move(owners));
+}
+
+inline void jit(const std::string& expr) { Profiler::instance().jit(expr); }
+
+// Measures the event loops run while it is alive. A scope opened inside another
+// one records nothing: its loops are part of the outer scope's entry.
+class Scope {
+  public:
+    explicit Scope(std::string label) : label_(std::move(label)) {
+        if (!enabled())
+            return;
+        entered_ = true;
+        if (!Profiler::instance().enter())
+            return;
+        active_ = true;
+        Profiler::instance().reset();
+        start_ = Profiler::now();
+        bytes_ = TFile::GetFileBytesRead();
+        jitted_ = Profiler::instance().jitted();
+    }
+
+    ~Scope() {
+        if (!entered_)
+            return;
+        auto& p = Profiler::instance();
+        if (active_)
+            p.record(label_, start_, Profiler::now(), TFile::GetFileBytesRead() - bytes_, p.jitted() - jitted_);
+        p.leave();
+    }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+  private:
+    std::string label_;
+    bool entered_ = false;
+    bool active_ = false;
+    long long start_ = 0;
+    Long64_t bytes_ = 0;
+    unsigned long long jitted_ = 0;
+};
+
+}
+}
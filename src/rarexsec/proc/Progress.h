@@ -0,0 +1,274 @@
+#pragma once
+#include <ROOT/RDataFrame.hxx>
+#include <TFile.h>
+#include <TTree.h>
+
+#include "rarexsec/proc/DataModel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace rarexsec {
+namespace progress {
+
+// Entries read from one Frame's root, counted per slot. The expected number of
+// entries per pass is resolved from the input files the first time results are
+// booked on the frame. A pending pass remembers the frame's run count, so a pass
+// that ends short of the expected entries is still retired once the loop ran.
+struct Counter {
+    struct alignas(64) Slot {
+        std::atomic<unsigned long long> entries{0};
+    };
+
+    std::string label;
+    std::string tree;
+    std::vector<std::string> files;
+    std::vector<Slot> slots;
+    long long total = -1;
+    unsigned long long base = 0;
+    bool pending = false;
+    std::weak_ptr<ROOT::RDataFrame> df;
+    unsigned runs = 0;
+
+    unsigned long long count() const {
+        unsigned long long n = 0;
+        for (const auto& s : slots)
+            n += s.entries.load(std::memory_order_relaxed);
+        return n;
+    }
+};
+
+// Number of entries of a tree summed over files, cached per (tree, file).
+inline long long entries(const std::string& tree, const std::vector<std::string>& files) {
+    static std::mutex mutex;
+    static std::map<std::pair<std::string, std::string>, long long> cache;
+    long long total = 0;
+    for (const auto& f : files) {
+        const auto key = std::make_pair(tree, f);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = cache.find(key);
+            if (it != cache.end()) {
+                total += it->second;
+                continue;
+            }
+        }
+        long long n = 0;
+        std::unique_ptr<TFile> file(TFile::Open(f.c_str(), "READ"));
+        if (!file || file->IsZombie())
+            return -1;
+        auto* t = file->Get<TTree>(tree.c_str());
+        if (!t)
+            return -1;
+        n = t->GetEntries();
+        std::lock_guard<std::mutex> lock(mutex);
+        cache[key] = n;
+        total += n;
+    }
+    return total;
+}
+
+inline std::string duration(double s) {
+    const long long t = static_cast<long long>(s + 0.5);
+    char buf[32];
+    if (t >= 3600)
+        std::snprintf(buf, sizeof(buf), "%lld:%02lld:%02lld", t / 3600, (t / 60) % 60, t % 60);
+    else
+        std::snprintf(buf, sizeof(buf), "%lld:%02lld", t / 60, t % 60);
+    return buf;
+}
+
+inline std::string count(double n) {
+    char buf[32];
+    if (n >= 1e9)
+        std::snprintf(buf, sizeof(buf), "%.2fG", n / 1e9);
+    else if (n >= 1e6)
+        std::snprintf(buf, sizeof(buf), "%.2fM", n / 1e6);
+    else if (n >= 1e3)
+        std::snprintf(buf, sizeof(buf), "%.1fk", n / 1e3);
+    else
+        std::snprintf(buf, sizeof(buf), "%.0f", n);
+    return buf;
+}
+
+// Aggregate progress of the event loops run over the Hub's frames. Booking results
+// on a frame adds one pass over its entries to the expected work; each frame root
+// counts the entries it reads per slot, and every few thousand entries a slot
+// checks whether a report is due. Reports go to stderr at most once per interval
+// and give entries done, throughput and ETA across all frames, detvars included.
+// Counters are held weakly: a pass booked on a frame that is destroyed before
+// its loop runs is dropped from the expected work.
+// On by default; RAREXSEC_PROGRESS=0 turns it off and RAREXSEC_PROGRESS_INTERVAL
+// sets the interval in seconds (default 10).
+class Monitor {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    static Monitor& instance() {
+        static Monitor m;
+        return m;
+    }
+
+    bool enabled() const { return enabled_; }
+
+    std::shared_ptr<Counter> counter(std::string label, std::string tree, std::vector<std::string> files,
+                                     unsigned nslots) {
+        if (!enabled_)
+            return nullptr;
+        auto c = std::make_shared<Counter>();
+        c->label = std::move(label);
+        c->tree = std::move(tree);
+        c->files = std::move(files);
+        c->slots = std::vector<Counter::Slot>(std::max(1u, nslots));
+        std::lock_guard<std::mutex> lock(mutex_);
+        settle();
+        counters_.push_back(Tracked{c, 0});
+        return c;
+    }
+
+    ROOT::RDF::RNode attach(ROOT::RDF::RNode node, const std::shared_ptr<Counter>& c) {
+        if (!c)
+            return node;
+        // The graph owns the counter from here on; Counter::df is weak, so no cycle.
+        return node.Filter([c](unsigned slot) {
+            auto& s = c->slots[slot % c->slots.size()];
+            if ((s.entries.fetch_add(1, std::memory_order_relaxed) & 0x3fff) == 0x3fff)
+                Monitor::instance().tick();
+            return true;
+        },
+                           {"rdfslot_"});
+    }
+
+    // Called when results are booked on a frame: its next pass becomes expected work.
+    void expect(const Frame& f) {
+        auto c = f.progress;
+        if (!c)
+            return;
+        std::lock_guard<std::mutex> lock(mutex_);
+        settle();
+        if (c->pending)
+            return;
+        if (c->total < 0)
+            c->total = c->tree.empty() ? 0 : entries(c->tree, c->files);
+        if (c->total <= 0)
+            return;
+        if (!running()) {
+            start_ = Clock::now();
+            next_.store(now_s() + interval_, std::memory_order_relaxed);
+        }
+        c->base = c->count();
+        c->pending = true;
+        c->df = f.df;
+        c->runs = f.df ? f.df->GetNRuns() : 0;
+        for (auto& t : counters_)
+            if (t.counter.lock() == c)
+                t.owed = c->total;
+        expected_ += c->total;
+    }
+
+    void tick() {
+        if (now_s() < next_.load(std::memory_order_relaxed))
+            return;
+        std::unique_lock<std::mutex> lock(mutex_, std::try_to_lock);
+        if (!lock.owns_lock())
+            return;
+        next_.store(now_s() + interval_, std::memory_order_relaxed);
+        settle();
+        if (!running())
+            return;
+        unsigned long long inflight = 0;
+        std::size_t active = 0, frames = 0;
+        for (auto& t : counters_) {
+            auto c = t.counter.lock();
+            if (!c || !c->pending)
+                continue;
+            ++frames;
+            const auto n = std::min<unsigned long long>(c->count() - c->base, c->total);
+            inflight += n;
+            active += n > 0 && n < static_cast<unsigned long long>(c->total);
+        }
+        const double done = static_cast<double>(done_ + inflight);
+        const double elapsed = std::chrono::duration<double>(Clock::now() - start_).count();
+        const double rate = elapsed > 0.0 ? done / elapsed : 0.0;
+        const double left = static_cast<double>(expected_) - done;
+        std::string line = "rarexsec: " + count(done) + "/" + count(static_cast<double>(expected_)) + " entries";
+        char pct[16];
+        std::snprintf(pct, sizeof(pct), " (%.1f%%)", expected_ ? 100.0 * done / expected_ : 0.0);
+        line += pct;
+        line += ", " + count(rate) + "/s, elapsed " + duration(elapsed);
+        if (rate > 0.0)
+            line += ", ETA " + duration(left / rate);
+        line += ", " + std::to_string(active) + " active / " + std::to_string(frames) + " pending frames";
+        std::cerr << line << std::endl;
+    }
+
+  private:
+    Monitor() {
+        const char* on = std::getenv("RAREXSEC_PROGRESS");
+        enabled_ = !(on && std::string(on) == "0");
+        if (const char* s = std::getenv("RAREXSEC_PROGRESS_INTERVAL"); s && *s)
+            interval_ = std::max(0.1, std::atof(s));
+    }
+
+    static double now_s() { return std::chrono::duration<double>(Clock::now().time_since_epoch()).count(); }
+
+    bool running() const { return expected_ > done_; }
+
+    // Retires frames whose pass has been read or whose loop has run, and drops
+    // counters whose frame is gone, with any pass still owed; caller holds mutex_.
+    void settle() {
+        for (auto it = counters_.begin(); it != counters_.end();) {
+            auto c = it->counter.lock();
+            if (!c) {
+                expected_ -= it->owed;
+                it = counters_.erase(it);
+                continue;
+            }
+            if (c->pending) {
+                const auto total = static_cast<unsigned long long>(c->total);
+                const auto read = std::min(c->count() - c->base, total);
+                const auto df = c->df.lock();
+                if (read == total || (df && df->GetNRuns() > c->runs)) {
+                    c->pending = false;
+                    it->owed = 0;
+                    done_ += read;
+                    expected_ -= total - read;
+                }
+            }
+            ++it;
+        }
+        if (!running())
+            expected_ = done_ = 0;
+    }
+
+    struct Tracked {
+        std::weak_ptr<Counter> counter;
+        unsigned long long owed = 0;
+    };
+
+    bool enabled_ = true;
+    double interval_ = 10.0;
+    std::atomic<double> next_{0.0};
+    Clock::time_point start_ = Clock::now();
+    unsigned long long expected_ = 0;
+    unsigned long long done_ = 0;
+    std::mutex mutex_;
+    std::vector<Tracked> counters_;
+};
+
+inline bool enabled() { return Monitor::instance().enabled(); }
+
+inline void expect(const Frame& f) { Monitor::instance().expect(f); }
+
+}
+}
@@ -0,0 +1,232 @@
+#pragma once
+#include "rarexsec/Hub.h"
+#include "rarexsec/proc/ColumnTrace.h"
+#include "rarexsec/proc/FileStamp.h"
+
+#include <ROOT/RDFHelpers.hxx>
+#include <TArrayD.h>
+#include <TH1D.h>
+#include <nlohmann/json.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace rarexsec {
+namespace store {
+
+// Histogram results shared between jobs through memory-mapped files, one per key.
+// Enabled by RAREXSEC_RESULT_STORE=<dir>; put <dir> on /dev/shm to share between
+// concurrent jobs on a node without touching disk. Dry runs neither read nor write
+// the store, since their histograms are empty.
+class ResultStore {
+  public:
+    static ResultStore& instance() {
+        static ResultStore s;
+        return s;
+    }
+
+    bool enabled() const { return !dir_.empty() && !trace::dry_run(); }
+    const std::string& dir() const { return dir_; }
+
+    std::unique_ptr<TH1D> load(const std::string& key, const ROOT::RDF::TH1DModel& model) const {
+        if (!enabled() || key.empty())
+            return nullptr;
+        const int fd = ::open(path(key).c_str(), O_RDONLY);
+        if (fd < 0)
+            return nullptr;
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(Header))) {
+            ::close(fd);
+            return nullptr;
+        }
+        const auto size = static_cast<std::size_t>(st.st_size);
+        void* map = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (map == MAP_FAILED)
+            return nullptr;
+
+        std::unique_ptr<TH1D> out;
+        const auto proto = model.GetHistogram();
+        const auto* axis = proto->GetXaxis();
+        const auto* base = static_cast<const char*>(map);
+        Header h{};
+        std::memcpy(&h, base, sizeof(h));
+        const std::size_t n = static_cast<std::size_t>(h.nbins) + 2;
+        const std::size_t body = sizeof(Header) + padded(h.key_size);
+        if (std::memcmp(h.magic, kMagic, sizeof(h.magic)) == 0 && h.key_size == key.size() &&
+            size == body + 2 * n * sizeof(double) && key.compare(0, key.size(), base + sizeof(Header), h.key_size) == 0 &&
+            h.nbins == proto->GetNbinsX() && h.xmin == axis->GetXmin() && h.xmax == axis->GetXmax()) {
+            out.reset(static_cast<TH1D*>(proto->Clone(model.fName)));
+            out->SetDirectory(nullptr);
+            out->Sumw2(true);
+            std::vector<double> values(2 * n);
+            std::memcpy(values.data(), base + body, values.size() * sizeof(double));
+            TArrayD& w2 = *out->GetSumw2();
+            for (std::size_t i = 0; i < n; ++i) {
+                out->SetBinContent(static_cast<int>(i), values[i]);
+                w2[static_cast<int>(i)] = values[n + i];
+            }
+            out->ResetStats();
+            out->SetEntries(h.entries);
+        }
+        ::munmap(map, size);
+        return out;
+    }
+
+    void save(const std::string& key, const TH1D& hist) const {
+        if (!enabled() || key.empty())
+            return;
+        Header h{};
+        std::memcpy(h.magic, kMagic, sizeof(h.magic));
+        h.key_size = key.size();
+        h.nbins = hist.GetNbinsX();
+        h.xmin = hist.GetXaxis()->GetXmin();
+        h.xmax = hist.GetXaxis()->GetXmax();
+        h.entries = hist.GetEntries();
+        const std::size_t n = static_cast<std::size_t>(h.nbins) + 2;
+        const std::size_t body = sizeof(Header) + padded(h.key_size);
+        const std::size_t size = body + 2 * n * sizeof(double);
+
+        std::error_code ec;
+        std::filesystem::create_directories(dir_, ec);
+        static std::atomic<unsigned> counter{0};
+        const auto final_path = path(key);
+        const auto tmp = final_path + ".tmp." + std::to_string(::getpid()) + "." + std::to_string(counter++);
+        const int fd = ::open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            return;
+        if (::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            ::close(fd);
+            ::unlink(tmp.c_str());
+            return;
+        }
+        void* map = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (map == MAP_FAILED) {
+            ::unlink(tmp.c_str());
+            return;
+        }
+        auto* base = static_cast<char*>(map);
+        std::memcpy(base, &h, sizeof(h));
+        std::memcpy(base + sizeof(Header), key.data(), key.size());
+        std::vector<double> values(2 * n);
+        const bool has_w2 = hist.GetSumw2N() > 0;
+        for (std::size_t i = 0; i < n; ++i) {
+            values[i] = hist.GetBinContent(static_cast<int>(i));
+            values[n + i] = has_w2 ? hist.GetSumw2()->At(static_cast<int>(i)) : values[i];
+        }
+        std::memcpy(base + body, values.data(), values.size() * sizeof(double));
+        ::munmap(map, size);
+        if (std::rename(tmp.c_str(), final_path.c_str()) != 0)
+            ::unlink(tmp.c_str());
+    }
+
+  private:
+    static constexpr char kMagic[8] = {'R', 'X', 'S', 'T', 'O', 'R', 'E', '1'};
+
+    struct Header {
+        char magic[8];
+        std::uint64_t key_size;
+        std::int32_t nbins;
+        std::int32_t reserved;
+        double xmin;
+        double xmax;
+        double entries;
+    };
+
+    ResultStore() {
+        const char* d = std::getenv("RAREXSEC_RESULT_STORE");
+        if (d && *d)
+            dir_ = d;
+    }
+
+    static std::size_t padded(std::size_t n) { return (n + 7) & ~std::size_t{7}; }
+
+    static std::uint64_t hash(const std::string& s) {
+        std::uint64_t h = 1469598103934665603ull;
+        for (unsigned char c : s) {
+            h ^= c;
+            h *= 1099511628211ull;
+        }
+        return h;
+    }
+
+    std::string path(const std::string& key) const {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.h1", static_cast<unsigned long long>(hash(key)));
+        return (std::filesystem::path(dir_) / name).string();
+    }
+
+    std::string dir_;
+};
+
+// Identity of the events behind a frame: sample metadata, normalisation and
+// the size and mtime of every input file.
+inline nlohmann::json frame_key(const Entry& e, const Frame& f, const std::string& detvar) {
+    return {{"beamline", e.beamline},
+            {"period", e.period},
+            {"source", static_cast<int>(e.source)},
+            {"slice", static_cast<int>(e.slice)},
+            {"detvar", detvar},
+            {"pot", {e.pot_nom, e.pot_eqv}},
+            {"trig", {e.trig_nom, e.trig_eqv}},
+            {"skim", e.skim_tree},
+            {"processor", Processor::version()},
+            {"files", files::stamp(f.files)}};
+}
+
+// Key of one histogram booked on a frame: the frame identity plus what was filled.
+// Frames with an input file that cannot be stat-ed get no key and bypass the store.
+inline std::string hist_key(const Entry& e, const Frame& f, const std::string& detvar, nlohmann::json what) {
+    if (!ResultStore::instance().enabled())
+        return {};
+    auto k = frame_key(e, f, detvar);
+    for (const auto& s : k.at("files")) {
+        if (s.contains("unstamped"))
+            return {};
+    }
+    k["hist"] = std::move(what);
+    return k.dump();
+}
+
+// A histogram either loaded from the store or booked on a frame; a booked one is
+// saved under its key the first time it is read.
+struct Part {
+    std::string key;
+    std::unique_ptr<TH1D> hit;
+    ROOT::RDF::RResultPtr<TH1D> booked;
+    bool saved = false;
+
+    const TH1D& get() {
+        if (hit)
+            return *hit;
+        const TH1D& h = booked.GetValue();
+        if (!saved) {
+            ResultStore::instance().save(key, h);
+            saved = true;
+        }
+        return h;
+    }
+};
+
+inline Part lookup(std::string key, const ROOT::RDF::TH1DModel& model) {
+    Part p;
+    p.hit = ResultStore::instance().load(key, model);
+    p.key = std::move(key);
+    return p;
+}
+
+}
+}
@@ -8,6 +8,9 @@
 #include <vector>
 
 #include "rarexsec/Hub.h"
+#include "rarexsec/proc/ColumnTrace.h"
+#include "rarexsec/proc/Profile.h"
+#include "rarexsec/proc/Progress.h"
 #include "rarexsec/proc/Volume.h"
 
 namespace rarexsec {
@@ -38,7 +41,54 @@ enum class Preset {
     InclusiveMuCC
 };
 
-inline ROOT::RDF::RNode apply(ROOT::RDF::RNode node, Preset p, const rarexsec::Entry& rec) {
+inline std::string preset_to_string(Preset p) {
+    switch (p) {
+    case Preset::Empty:
+        return "Empty";
+    case Preset::Trigger:
+        return "Trigger";
+    case Preset::Slice:
+        return "Slice";
+    case Preset::Fiducial:
+        return "Fiducial";
+    case Preset::Topology:
+        return "Topology";
+    case Preset::Muon:
+        return "Muon";
+    case Preset::InclusiveMuCC:
+        return "InclusiveMuCC";
+    }
+    return "unknown";
+}
+
+inline std::vector<std::string> columns(Preset p) {
+    switch (p) {
+    case Preset::Empty:
+        return {};
+    case Preset::Trigger:
+        return {"optical_filter_pe_beam", "optical_filter_pe_veto", "software_trigger"};
+    case Preset::Slice:
+        return {"num_slices", "topological_score"};
+    case Preset::Fiducial:
+        return {"in_reco_fiducial"};
+    case Preset::Topology:
+        return {"contained_fraction", "slice_cluster_fraction"};
+    case Preset::Muon:
+        return {"track_shower_scores", "trk_llr_pid_v", "track_length", "track_distance_to_vertex",
+                "pfp_generations"};
+    case Preset::InclusiveMuCC:
+    default: {
+        std::vector<std::string> out;
+        for (Preset q : {Preset::Trigger, Preset::Slice, Preset::Fiducial, Preset::Topology, Preset::Muon}) {
+            auto c = columns(q);
+            out.insert(out.end(), c.begin(), c.end());
+        }
+        return out;
+    }
+    }
+}
+
+inline ROOT::RDF::RNode filter(ROOT::RDF::RNode node, Preset p, const rarexsec::Entry& rec) {
     switch (p) {
     case Preset::Empty:
         return node;
@@ -52,22 +102,22 @@ inline ROOT::RDF::RNode apply(ROOT::RDF::RNode node, Preset p, const rarexsec::E
                                           : true;
             return dataset_gate;
         },
-                           {"optical_filter_pe_beam", "optical_filter_pe_veto", "software_trigger"});
+                           {"optical_filter_pe_beam", "optical_filter_pe_veto", "software_trigger"}, "trigger");
     case Preset::Slice:
         return node.Filter([](int ns, float topo) {
             return ns == slice_required_count &&
                    topo > slice_min_topology_score;
         },
-                           {"num_slices", "topological_score"});
+                           {"num_slices", "topological_score"}, "slice");
     case Preset::Fiducial:
         return node.Filter([](bool fv) { return fv; },
-                           {"in_reco_fiducial"});
+                           {"in_reco_fiducial"}, "fiducial");
     case Preset::Topology:
         return node.Filter([](float cf, float cl) {
             return cf >= topology_min_contained_fraction &&
                    cl >= topology_min_cluster_fraction;
         },
-                           {"contained_fraction", "slice_cluster_fraction"});
+                           {"contained_fraction", "slice_cluster_fraction"}, "topology");
     case Preset::Muon:
         return node.Filter(
             [](const ROOT::RVec<float>& scores,
@@ -92,18 +142,27 @@ inline ROOT::RDF::RNode apply(ROOT::RDF::RNode node, Preset p, const rarexsec::E
              "trk_llr_pid_v",
              "track_length",
              "track_distance_to_vertex",
-             "pfp_generations"});
+             "pfp_generations"},
+            "muon");
     case Preset::InclusiveMuCC:
     default: {
-        auto filtered = apply(node, Preset::Trigger, rec);
-        filtered = apply(filtered, Preset::Slice, rec);
-        filtered = apply(filtered, Preset::Fiducial, rec);
-        filtered = apply(filtered, Preset::Topology, rec);
-        return apply(filtered, Preset::Muon, rec);
+        auto filtered = filter(node, Preset::Trigger, rec);
+        filtered = filter(filtered, Preset::Slice, rec);
+        filtered = filter(filtered, Preset::Fiducial, rec);
+        filtered = filter(filtered, Preset::Topology, rec);
+        return filter(filtered, Preset::Muon, rec);
     }
     }
 }
 
+inline ROOT::RDF::RNode apply(ROOT::RDF::RNode node, Preset p, const rarexsec::Entry& rec) {
+    trace::use(columns(p));
+    auto out = filter(node, p, rec);
+    if (p != Preset::Empty)
+        profile::cuts(out, rec, profile::label(rec) + "/" + preset_to_string(p));
+    return out;
+}
+
 struct EvalResult {
     double denom = 0.0;
     double numer = 0.0;
@@ -116,16 +175,22 @@ template <class SignalPredicate>
 inline EvalResult evaluate(const std::vector<const rarexsec::Entry*>& mc,
                            const SignalPredicate& is_signal_truth,
                            Preset final_selection) {
-    auto sumw = [](ROOT::RDF::RNode n){ auto r = n.Sum<float>("w_nominal"); return double(r.GetValue()); };
+    auto sumw = [](const Frame& f, ROOT::RDF::RNode n){
+        progress::expect(f);
+        profile::Scope scope("selection::evaluate");
+        auto r = n.Sum<float>("w_nominal");
+        return double(r.GetValue());
+    };
     EvalResult out;
+    trace::use({"w_nominal", "analysis_channels"});
     for (const rarexsec::Entry* rec : mc) {
         ROOT::RDF::RNode base = rec->nominal.rnode();
         auto denom = base.Filter([&](int ch){ return is_signal_truth(ch); }, {"analysis_channels"});
-        out.denom += sumw(denom);
+        out.denom += sumw(rec->nominal, denom);
         auto sel = apply(base, final_selection, *rec);
-        out.selected += sumw(sel);
+        out.selected += sumw(rec->nominal, sel);
         auto numer = sel.Filter([&](int ch){ return is_signal_truth(ch); }, {"analysis_channels"});
-        out.numer += sumw(numer);
+        out.numer += sumw(rec->nominal, numer);
     }
     return out;
 }
@@ -1,13 +1,34 @@
 #pragma once
 #include "rarexsec/Hub.h"
+#include "rarexsec/proc/ColumnTrace.h"
+#include "rarexsec/proc/Expression.h"
+#include "rarexsec/proc/FileStamp.h"
+#include "rarexsec/proc/Memory.h"
+#include "rarexsec/proc/Profile.h"
+#include "rarexsec/proc/Progress.h"
+#include "rarexsec/proc/Selection.h"
+#include "rarexsec/proc/SparseImage.h"
 
 #include <ROOT/RDFHelpers.hxx>
 #include <ROOT/RDataFrame.hxx>
 #include <ROOT/RSnapshotOptions.hxx>
+#include <ROOT/RVec.hxx>
+#include <TFile.h>
+#include <TFileMerger.h>
+#include <Compression.h>
+#include <RVersion.h>
+#include <TNamed.h>
+#include <nlohmann/json.hpp>
 
 #include <algorithm>
 #include <cctype>
+#include <cmath>
+#include <cstdio>
 #include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <stdexcept>
 #include <string>
 #include <string_view>
 #include <unordered_set>
@@ -16,13 +37,57 @@
 namespace rarexsec {
 namespace snapshot {
 
+enum class Format { TTree,
+                    RNTuple };
+
+enum class MapEncoding { Map,
+                         UShort,
+                         Float };
+
 struct Options {
     std::string outdir = "snapshots";
     std::string outfile = "all_samples.root";
     std::string tree = "analysis";
     std::vector<std::string> columns;
+    selection::Preset preset = selection::Preset::Empty;
+    std::string filter;
+    Format format = Format::TTree;
+    bool incremental = true;
+    int shards = 1;
+    ROOT::RCompressionSetting::EAlgorithm::EValues compression_algorithm =
+        ROOT::RCompressionSetting::EAlgorithm::kZLIB;
+    int compression_level = 1;
+    int basket_size = -1;
+    int auto_flush = 0;
+    int split_level = 99;
+    std::map<std::string, std::vector<std::string>> map_keys;
+    MapEncoding map_encoding = MapEncoding::Map;
+    double map_us_scale = 1.0 / 1000.0;
+    bool keep_maps = false;
+    std::vector<std::string> sparse_images;
+    double sparse_threshold = 4.0;
+    bool keep_dense_images = false;
+    bool parallel = true;
+    bool keep_parts = false;
 };
 
+inline ROOT::RDF::RSnapshotOptions snapshot_options(const Options& opt, const std::string& mode) {
+    ROOT::RDF::RSnapshotOptions sopt;
+    sopt.fMode = mode;
+    sopt.fCompressionAlgorithm = opt.compression_algorithm;
+    sopt.fCompressionLevel = opt.compression_level;
+    sopt.fAutoFlush = opt.auto_flush;
+    sopt.fSplitLevel = opt.split_level;
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6, 30, 0)
+    sopt.fBasketSize = opt.basket_size;
+#endif
+    return sopt;
+}
+
+inline int compression_settings(const Options& opt) {
+    return ROOT::CompressionSettings(opt.compression_algorithm, opt.compression_level);
+}
+
 inline std::string source_to_string(Source s) {
     switch (s) {
     case Source::Data:
@@ -67,87 +132,651 @@ inline std::string sanitise(std::string s) {
     return s;
 }
 
+// Columns kept when Options::columns is empty: event identity under both the
+// ntuple and the EventDisplay/events::Index names, the nominal weight and
+// channel, and the systematics weight branches with their central values.
+// The list is fixed, so a skim and its fingerprint do not depend on what else
+// ran in the process; to keep traced columns, pass trace::minimal_columns(node)
+// or trace::load(path) as Options::columns. Columns absent from a frame are
+// skipped and recorded as unavailable in the provenance.
 inline const std::vector<std::string>& default_columns() {
     static const std::vector<std::string> cols{
         "run",
         "subrun",
         "event",
+        "sub",
+        "evt",
         "w_nominal",
         "analysis_channels",
+        "weightsPPFX",
+        "ppfx_cv",
+        "weightsGenie",
+        "weightSplineTimesTune",
+        "weightsReint",
     };
     return cols;
 }
 
-inline std::vector<std::string> intersect_cols(ROOT::RDF::RNode node, const std::vector<std::string>& wanted) {
+inline std::vector<std::string> requested_cols(const std::vector<std::string>& wanted,
+                                               const std::vector<std::string>& extra = {}) {
+    auto req = wanted;
+    if (req.empty())
+        req = default_columns();
+    req.insert(req.end(), extra.begin(), extra.end());
+    std::unordered_set<std::string> seen;
+    req.erase(std::remove_if(req.begin(), req.end(), [&](const std::string& c) { return !seen.insert(c).second; }),
+              req.end());
+    return req;
+}
+
+inline std::vector<std::string> intersect_cols(ROOT::RDF::RNode node, const std::vector<std::string>& wanted,
+                                               const std::vector<std::string>& extra = {}) {
     auto have = node.GetColumnNames();
     std::unordered_set<std::string> avail(have.begin(), have.end());
-    const auto& req = wanted.empty() ? default_columns() : wanted;
-
     std::vector<std::string> out;
-    out.reserve(req.size());
-    for (const auto& c : req) {
+    for (const auto& c : requested_cols(wanted, extra)) {
         if (avail.count(c))
             out.push_back(c);
     }
     return out;
 }
 
-inline std::string make_out_path(const Options& opt, const Entry& e, const std::string& detvar) {
+inline std::vector<std::string> unavailable_cols(ROOT::RDF::RNode node, const std::vector<std::string>& wanted,
+                                                 const std::vector<std::string>& extra = {}) {
+    auto have = node.GetColumnNames();
+    std::unordered_set<std::string> avail(have.begin(), have.end());
+    std::vector<std::string> out;
+    for (const auto& c : requested_cols(wanted, extra)) {
+        if (!avail.count(c))
+            out.push_back(c);
+    }
+    return out;
+}
+
+inline std::string map_encoding_to_string(MapEncoding enc) {
+    switch (enc) {
+    case MapEncoding::Map:
+        return "map";
+    case MapEncoding::UShort:
+        return "ushort";
+    case MapEncoding::Float:
+        return "float";
+    }
+    return "unknown";
+}
+
+inline std::string map_column(const std::string& branch, const std::string& key, MapEncoding enc) {
+    std::string id = key;
+    for (char& c : id) {
+        if (!(std::isalnum(static_cast<unsigned char>(c)) || c == '_'))
+            c = '_';
+    }
+    return branch + "__" + id + (enc == MapEncoding::UShort ? "_us" : "");
+}
+
+struct MapColumn {
+    std::string branch;
+    std::string key;
+    std::string column;
+};
+
+inline std::vector<MapColumn> map_columns(ROOT::RDF::RNode node, const Options& opt) {
+    std::vector<MapColumn> out;
+    if (opt.map_encoding == MapEncoding::Map)
+        return out;
+    for (const auto& [branch, keys] : opt.map_keys) {
+        if (!node.HasColumn(branch))
+            continue;
+        if (keys.empty())
+            throw std::invalid_argument("snapshot: no keys listed for map branch " + branch);
+        for (const auto& key : keys)
+            out.push_back({branch, key, map_column(branch, key, opt.map_encoding)});
+    }
+    return out;
+}
+
+inline ROOT::RDF::RNode encode_maps(ROOT::RDF::RNode node, const Options& opt) {
+    const auto maps = map_columns(node, opt);
+    if (maps.empty())
+        return node;
+    if (opt.map_encoding == MapEncoding::Float) {
+        for (const auto& m : maps) {
+            node = node.Define(
+                m.column,
+                [key = m.key](const std::map<std::string, std::vector<double>>& w) {
+                    ROOT::RVec<float> out;
+                    auto it = w.find(key);
+                    if (it != w.end())
+                        out.assign(it->second.begin(), it->second.end());
+                    return out;
+                },
+                {m.branch});
+        }
+        return node;
+    }
+    if (!(opt.map_us_scale > 0.0))
+        throw std::invalid_argument("snapshot: map_us_scale must be positive");
+    const double inv = 1.0 / opt.map_us_scale;
+    for (const auto& m : maps) {
+        node = node.Define(
+            m.column,
+            [key = m.key, inv](const std::map<std::string, std::vector<double>>& w) {
+                ROOT::RVec<unsigned short> out;
+                auto it = w.find(key);
+                if (it == w.end())
+                    return out;
+                out.resize(it->second.size());
+                for (std::size_t i = 0; i < out.size(); ++i) {
+                    const double q = std::round(it->second[i] * inv);
+                    out[i] = std::isfinite(q) ? static_cast<unsigned short>(std::clamp(q, 0.0, 65535.0)) : 0;
+                }
+                return out;
+            },
+            {m.branch});
+    }
+    return node;
+}
+
+inline std::vector<std::string> sparse_columns(ROOT::RDF::RNode node, const Options& opt) {
+    std::vector<std::string> out;
+    for (const auto& col : opt.sparse_images) {
+        if (node.HasColumn(col))
+            out.push_back(col);
+    }
+    return out;
+}
+
+// Element type of an RVec or std::vector column type name, or "" for anything else.
+inline std::string element_type(std::string type) {
+    type.erase(std::remove_if(type.begin(), type.end(), [](unsigned char c) { return std::isspace(c); }), type.end());
+    if (type == "ROOT::RVecF" || type == "RVecF")
+        return "float";
+    if (type == "ROOT::RVecI" || type == "RVecI")
+        return "int";
+    for (const std::string_view prefix : {"ROOT::VecOps::RVec<", "ROOT::RVec<", "RVec<", "std::vector<", "vector<"}) {
+        if (type.size() > prefix.size() && type.compare(0, prefix.size(), prefix) == 0 && type.back() == '>') {
+            auto inner = type.substr(prefix.size(), type.size() - prefix.size() - 1);
+            inner = inner.substr(0, inner.find(','));
+            if (inner == "Float_t")
+                inner = "float";
+            else if (inner == "Int_t")
+                inner = "int";
+            return inner;
+        }
+    }
+    return {};
+}
+
+inline ROOT::RDF::RNode encode_images(ROOT::RDF::RNode node, const Options& opt) {
+    for (const auto& col : sparse_columns(node, opt)) {
+        const auto type = node.GetColumnType(col);
+        const auto element = element_type(type);
+        const auto idx = sparse::index_column(col);
+        const auto val = sparse::value_column(col);
+        const auto size = sparse::size_column(col);
+        const auto tmp = "_sparse_" + col;
+        if (element == "float") {
+            const float threshold = static_cast<float>(opt.sparse_threshold);
+            node = node.Define(tmp, [threshold](const ROOT::RVec<float>& v) { return sparse::encode(v, threshold); }, {col})
+                       .Define(idx, [](const sparse::Image<float>& s) { return s.index; }, {tmp})
+                       .Define(val, [](const sparse::Image<float>& s) { return s.value; }, {tmp})
+                       .Define(size, [](const sparse::Image<float>& s) { return s.size; }, {tmp});
+        } else if (element == "int") {
+            node = node.Define(tmp, [](const ROOT::RVec<int>& v) { return sparse::encode(v, 0); }, {col})
+                       .Define(idx, [](const sparse::Image<int>& s) { return s.index; }, {tmp})
+                       .Define(val, [](const sparse::Image<int>& s) { return s.value; }, {tmp})
+                       .Define(size, [](const sparse::Image<int>& s) { return s.size; }, {tmp});
+        } else {
+            throw std::invalid_argument("snapshot: cannot store " + type + " column " + col + " sparsely");
+        }
+    }
+    return node;
+}
+
+inline ROOT::RDF::RNode encode_columns(ROOT::RDF::RNode node, const Options& opt) {
+    return encode_images(encode_maps(node, opt), opt);
+}
+
+inline std::string sample_stem(const Entry& e, const std::string& detvar) {
     const auto base = e.files.empty() ? std::string{}
-                                      : std::filesystem::path(e.files.front()).filename().string();
+                                      : std::filesystem::path(e.files.front()).stem().string();
     std::string name = sanitise(e.beamline) + "_" +
                        sanitise(e.period) + "_" +
                        sanitise(sample_label(e));
-    if (!detvar.empty()) {
+    if (!base.empty())
+        name += "__" + sanitise(base);
+    if (!detvar.empty())
         name += "__" + sanitise(detvar);
-        return name;
+    return name;
+}
+
+inline std::string make_tree_name(const Options& opt, const Entry& e, const std::string& detvar) {
+    std::string name = opt.tree + "_" + sample_stem(e, detvar);
+    std::replace(name.begin(), name.end(), '.', '_');
+    return name;
+}
+
+inline std::string make_out_file(const Options& opt) {
+    std::filesystem::create_directories(opt.outdir);
+    return (std::filesystem::path(opt.outdir) / opt.outfile).string();
+}
+
+inline std::string make_parts_dir(const Options& opt) {
+    return (std::filesystem::path(opt.outdir) /
+            (".parts_" + std::filesystem::path(opt.outfile).stem().string()))
+        .string();
+}
+
+inline std::string make_ntuple_dir(const Options& opt) {
+    return (std::filesystem::path(opt.outdir) / std::filesystem::path(opt.outfile).stem()).string();
+}
+
+inline std::string make_ntuple_path(const Options& opt, const std::string& tree) {
+    return (std::filesystem::path(make_ntuple_dir(opt)) / (tree + ".root")).string();
+}
+
+inline std::string make_shard_dir(const Options& opt) {
+    return (std::filesystem::path(opt.outdir) /
+            (std::filesystem::path(opt.outfile).stem().string() + "_shards"))
+        .string();
+}
+
+inline std::string make_manifest_path(const Options& opt) {
+    return (std::filesystem::path(make_shard_dir(opt)) / "manifest.json").string();
+}
+
+inline std::string make_out_path(const Options& opt, const Entry& e, const std::string& detvar) {
+    return (std::filesystem::path(make_parts_dir(opt)) / (sample_stem(e, detvar) + ".root")).string();
+}
+
+inline std::string provenance_name(const std::string& tree) { return tree + "_provenance"; }
+
+struct Job {
+    ROOT::RDF::RNode node;
+    const Entry* entry;
+    std::string detvar;
+    std::vector<std::string> files;
+    std::string tree;
+    std::string part;
+    std::vector<std::string> columns;
+    const Frame* frame = nullptr;
+    std::vector<std::string> unavailable;
+};
+
+inline nlohmann::json fingerprint(const Job& j, const Options& opt) {
+    nlohmann::json fp;
+    fp["files"] = files::stamp(j.files);
+    fp["columns"] = j.columns;
+    fp["processor"] = Processor::version();
+    fp["preset"] = selection::preset_to_string(opt.preset);
+    fp["filter"] = opt.filter;
+    fp["format"] = opt.format == Format::RNTuple ? "rntuple" : "ttree";
+    fp["compression"] = compression_settings(opt);
+    fp["basket_size"] = opt.basket_size;
+    fp["auto_flush"] = opt.auto_flush;
+    fp["split_level"] = opt.split_level;
+    fp["map_keys"] = opt.map_keys;
+    fp["map_encoding"] = map_encoding_to_string(opt.map_encoding);
+    fp["map_us_scale"] = opt.map_us_scale;
+    fp["keep_maps"] = opt.keep_maps;
+    fp["sparse_images"] = opt.sparse_images;
+    fp["sparse_threshold"] = opt.sparse_threshold;
+    fp["keep_dense_images"] = opt.keep_dense_images;
+    return fp;
+}
+
+inline std::string provenance(const Job& j, const Options& opt) {
+    const Entry& e = *j.entry;
+    nlohmann::json p;
+    p["beamline"] = e.beamline;
+    p["period"] = e.period;
+    p["sample"] = sample_label(e);
+    p["detvar"] = j.detvar;
+    p["files"] = j.files;
+    p["pot_nom"] = e.pot_nom;
+    p["pot_eqv"] = e.pot_eqv;
+    p["trig_nom"] = e.trig_nom;
+    p["trig_eqv"] = e.trig_eqv;
+    p["preset"] = selection::preset_to_string(opt.preset);
+    p["filter"] = opt.filter;
+    p["columns"] = j.columns;
+    p["unavailable"] = j.unavailable;
+    nlohmann::json scales = nlohmann::json::object();
+    if (opt.map_encoding == MapEncoding::UShort) {
+        for (const auto& [branch, keys] : opt.map_keys) {
+            for (const auto& key : keys) {
+                const auto col = map_column(branch, key, opt.map_encoding);
+                if (std::find(j.columns.begin(), j.columns.end(), col) != j.columns.end())
+                    scales[col] = opt.map_us_scale;
+            }
+        }
     }
+    p["scales"] = scales;
+    p["fingerprint"] = fingerprint(j, opt);
+    return p.dump();
+}
 
-    inline std::string make_out_file(const Options& opt) {
-        std::filesystem::create_directories(opt.outdir);
-        return (std::filesystem::path(opt.outdir) / opt.outfile).string();
+inline bool up_to_date(TFile& f, const Job& j, const Options& opt) {
+    if (!f.GetKey(j.tree.c_str()))
+        return false;
+    std::unique_ptr<TNamed> meta{f.Get<TNamed>(provenance_name(j.tree).c_str())};
+    if (!meta)
+        return false;
+    const auto p = nlohmann::json::parse(meta->GetTitle(), nullptr, false);
+    return !p.is_discarded() && p.contains("fingerprint") && p.at("fingerprint") == fingerprint(j, opt);
+}
+
+inline std::vector<Job> stale_jobs(const std::vector<Job>& jobs, const Options& opt) {
+    std::vector<Job> out;
+    std::unique_ptr<TFile> combined;
+    if (opt.format == Format::TTree) {
+        const auto path = make_out_file(opt);
+        if (!std::filesystem::exists(path))
+            return jobs;
+        combined.reset(TFile::Open(path.c_str(), "READ"));
+        if (!combined || combined->IsZombie())
+            return jobs;
     }
+    for (const auto& j : jobs) {
+        std::unique_ptr<TFile> own;
+        TFile* f = combined.get();
+        if (opt.format == Format::RNTuple) {
+            const auto path = make_ntuple_path(opt, j.tree);
+            if (std::filesystem::exists(path))
+                own.reset(TFile::Open(path.c_str(), "READ"));
+            f = own.get();
+        }
+        if (!f || f->IsZombie() || !up_to_date(*f, j, opt))
+            out.push_back(j);
+    }
+    return out;
+}
 
-    inline std::vector<std::string> write(const std::vector<const Entry*>& samples,
-                                          const Options& opt = {}) {
-        std::vector<std::string> outputs;
-        outputs.reserve(1);
+inline void write_provenance(const std::string& path, const std::vector<Job>& jobs, const Options& opt) {
+    std::unique_ptr<TFile> f{TFile::Open(path.c_str(), "UPDATE")};
+    if (!f || f->IsZombie())
+        throw std::runtime_error("snapshot: cannot open " + path + " for update");
+    for (const auto& j : jobs) {
+        TNamed meta(provenance_name(j.tree).c_str(), provenance(j, opt).c_str());
+        f->WriteTObject(&meta, nullptr, "WriteDelete");
+    }
+    f->Close();
+}
+
+inline ROOT::RDF::RNode apply_selection(ROOT::RDF::RNode node, const Entry& e, const Options& opt) {
+    node = selection::apply(node, opt.preset, e);
+    if (!opt.filter.empty())
+        node = expr::filter(node, opt.filter, "skim");
+    return node;
+}
+
+inline std::vector<Job> plan(const std::vector<const Entry*>& samples, const Options& opt) {
+    std::vector<Job> jobs;
+    std::unordered_set<std::string> seen;
+    const auto preset_cols = selection::columns(opt.preset);
+    auto add = [&](const Frame& frame, const Entry& e, const std::string& tag) {
+        auto node = frame.rnode();
+        auto tree = make_tree_name(opt, e, tag);
+        if (!seen.insert(tree).second)
+            throw std::runtime_error("snapshot: duplicate tree name " + tree);
+        auto cols = intersect_cols(node, opt.columns, preset_cols);
+        auto unavailable = unavailable_cols(node, opt.columns, preset_cols);
+        for (const auto& m : map_columns(node, opt)) {
+            if (!opt.keep_maps)
+                cols.erase(std::remove(cols.begin(), cols.end(), m.branch), cols.end());
+            cols.push_back(m.column);
+        }
+        for (const auto& col : sparse_columns(node, opt)) {
+            if (!opt.keep_dense_images)
+                cols.erase(std::remove(cols.begin(), cols.end(), col), cols.end());
+            cols.push_back(sparse::index_column(col));
+            cols.push_back(sparse::value_column(col));
+            cols.push_back(sparse::size_column(col));
+        }
+        node = encode_columns(apply_selection(node, e, opt), opt);
+        jobs.push_back(Job{node, &e, tag, frame.files, std::move(tree), make_out_path(opt, e, tag), std::move(cols), &frame,
+                           std::move(unavailable)});
+    };
+    for (const Entry* e : samples) {
+        if (!e)
+            continue;
+        add(e->nominal, *e, "");
+        for (const auto& kv : e->detvars)
+            add(kv.second, *e, kv.first);
+    }
+    return jobs;
+}
 
-        const std::string outFile = make_out_file(opt);
-        bool fileExists = std::filesystem::exists(outFile);
+inline void drop_trees(const std::string& path, const std::vector<Job>& jobs) {
+    std::unique_ptr<TFile> f{TFile::Open(path.c_str(), "UPDATE")};
+    if (!f || f->IsZombie())
+        throw std::runtime_error("snapshot: cannot open " + path + " for update");
+    for (const auto& j : jobs) {
+        if (f->GetKey(j.tree.c_str()))
+            f->Delete((j.tree + ";*").c_str());
+    }
+    f->Close();
+}
+
+inline void write_sequential(const std::vector<Job>& jobs, const Options& opt,
+                             const std::string& outFile, bool fileExists) {
+    for (const auto& j : jobs) {
+        auto sopt = snapshot_options(opt, fileExists ? "UPDATE" : "RECREATE");
+        sopt.fOverwriteIfExists = true;
+        auto node = j.node;
+        node.Snapshot(j.tree, outFile, j.columns, sopt).GetValue();
+        fileExists = true;
+    }
+}
+
+inline void write_parallel(const std::vector<Job>& jobs, const Options& opt,
+                           const std::string& outFile, bool fileExists) {
+    const auto partsDir = make_parts_dir(opt);
+    std::filesystem::remove_all(partsDir);
+    std::filesystem::create_directories(partsDir);
+
+    std::vector<ROOT::RDF::RResultHandle> handles;
+    handles.reserve(jobs.size());
+    for (const auto& j : jobs) {
+        auto sopt = snapshot_options(opt, "RECREATE");
+        sopt.fLazy = true;
+        auto node = j.node;
+        handles.emplace_back(node.Snapshot(j.tree, j.part, j.columns, sopt));
+    }
+    ROOT::RDF::RunGraphs(handles);
 
-        auto snapshot_once = [&](ROOT::RDF::RNode node,
-                                 const std::string& treeName,
-                                 const std::vector<std::string>& cols) {
-            ROOT::RDF::RSnapshotOptions sopt;
-            sopt.fMode = fileExists ? "UPDATE" : "RECREATE";
-            sopt.fOverwriteIfExists = true;
-            node.Snapshot(treeName, outFile, cols, sopt).GetValue();
-            fileExists = true;
-        };
+    if (fileExists)
+        drop_trees(outFile, jobs);
 
-        for (const Entry* e : samples) {
-            if (!e)
+    TFileMerger merger(false, false);
+    merger.SetFastMethod(true);
+    merger.SetPrintLevel(0);
+    if (!merger.OutputFile(outFile.c_str(), fileExists ? "UPDATE" : "RECREATE", compression_settings(opt)))
+        throw std::runtime_error("snapshot: cannot open merge output " + outFile);
+    for (const auto& j : jobs) {
+        if (!merger.AddFile(j.part.c_str(), false))
+            throw std::runtime_error("snapshot: cannot add part " + j.part);
+    }
+    if (!merger.Merge())
+        throw std::runtime_error("snapshot: merge into " + outFile + " failed");
+
+    if (!opt.keep_parts)
+        std::filesystem::remove_all(partsDir);
+}
+
+inline void write_ntuples(const std::vector<Job>& jobs, const Options& opt) {
+#if ROOT_VERSION_CODE < ROOT_VERSION(6, 34, 0)
+    (void)jobs;
+    (void)opt;
+    throw std::runtime_error("snapshot: RNTuple output requires ROOT >= 6.34");
+#else
+    std::filesystem::create_directories(make_ntuple_dir(opt));
+
+    std::vector<ROOT::RDF::RResultHandle> handles;
+    for (const auto& j : jobs) {
+        auto sopt = snapshot_options(opt, "RECREATE");
+        sopt.fLazy = opt.parallel;
+        sopt.fOutputFormat = ROOT::RDF::ESnapshotOutputFormat::kRNTuple;
+        auto node = j.node;
+        auto res = node.Snapshot(j.tree, make_ntuple_path(opt, j.tree), j.columns, sopt);
+        if (opt.parallel)
+            handles.emplace_back(res);
+    }
+    if (!handles.empty())
+        ROOT::RDF::RunGraphs(handles);
+
+    for (const auto& j : jobs)
+        write_provenance(make_ntuple_path(opt, j.tree), {j}, opt);
+#endif
+}
+
+inline std::vector<std::vector<std::string>> split_files(const std::vector<std::string>& files, int shards) {
+    if (files.empty())
+        throw std::invalid_argument("snapshot: cannot shard a job without input files");
+    const std::size_t n = std::min<std::size_t>(static_cast<std::size_t>(std::max(shards, 1)), files.size());
+    std::vector<std::vector<std::string>> out(n);
+    for (std::size_t i = 0; i < files.size(); ++i)
+        out[i * n / files.size()].push_back(files[i]);
+    return out;
+}
+
+inline nlohmann::json read_manifest(const std::string& path) {
+    std::ifstream in(path);
+    if (!in)
+        return nlohmann::json::object();
+    auto m = nlohmann::json::parse(in, nullptr, false);
+    if (m.is_discarded() || !m.is_object())
+        return nlohmann::json::object();
+    return m;
+}
+
+inline void write_manifest(const std::string& path, const nlohmann::json& manifest) {
+    const auto tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        if (!out)
+            throw std::runtime_error("snapshot: cannot open " + tmp);
+        out << manifest.dump(2) << "\n";
+    }
+    std::filesystem::rename(tmp, path);
+}
+
+inline std::vector<std::string> write_sharded(const std::vector<Job>& jobs, const Options& opt) {
+    if (opt.format != Format::TTree)
+        throw std::invalid_argument("snapshot: sharded output is only supported for TTree");
+    const auto dir = make_shard_dir(opt);
+    const auto manifestPath = make_manifest_path(opt);
+    std::filesystem::create_directories(dir);
+
+    auto manifest = read_manifest(manifestPath);
+    manifest["tree_prefix"] = opt.tree;
+    auto& trees = manifest["trees"];
+    if (!trees.is_object())
+        trees = nlohmann::json::object();
+
+    std::vector<Frame> frames;
+    std::vector<ROOT::RDF::RResultHandle> handles;
+    for (const auto& j : jobs) {
+        const auto prov = nlohmann::json::parse(provenance(j, opt));
+        if (opt.incremental && trees.contains(j.tree)) {
+            const auto& old = trees.at(j.tree);
+            const auto files = old.value("files", nlohmann::json::array());
+            const bool present = std::all_of(files.begin(), files.end(), [&](const nlohmann::json& f) {
+                const std::filesystem::path p(f.get<std::string>());
+                return p.is_relative() && std::filesystem::exists(std::filesystem::path(dir) / p);
+            });
+            if (present && old.contains("provenance") &&
+                old.at("provenance").value("fingerprint", nlohmann::json{}) == prov.at("fingerprint"))
                 continue;
+        }
 
-            {
-                const auto cols = intersect_cols(e->rnode(), opt.columns);
-                const auto treeName = make_tree_name(opt, *e, "");
-                snapshot_once(e->rnode(), treeName, cols);
-            }
+        const auto treeDir = std::filesystem::path(dir) / j.tree;
+        std::filesystem::remove_all(treeDir);
+        std::filesystem::create_directories(treeDir);
 
-            for (const auto& kv : e->detvars) {
-                const auto& tag = kv.first;
-                const auto& dv = kv.second;
-                const auto cols = intersect_cols(dv.rnode(), opt.columns);
-                const auto treeName = make_tree_name(opt, *e, tag);
-                snapshot_once(dv.rnode(), treeName, cols);
+        nlohmann::json files = nlohmann::json::array();
+        const auto chunks = split_files(j.files, opt.shards);
+        for (std::size_t i = 0; i < chunks.size(); ++i) {
+            ROOT::RDF::RNode node = j.node;
+            if (chunks.size() > 1) {
+                // A frame read from a skim is rebuilt from the same skim tree, so the
+                // shard is not run through the Processor a second time.
+                Entry shard = *j.entry;
+                if (!j.frame->skim_tree.empty()) {
+                    shard.skim_files = chunks[i];
+                    shard.skim_tree = j.frame->skim_tree;
+                    shard.skim_rntuple = j.frame->skim_rntuple;
+                    shard.skim_scales = j.frame->scales;
+                } else {
+                    shard.files = chunks[i];
+                    shard.file = chunks[i].front();
+                    shard.skim_files.clear();
+                    shard.skim_tree.clear();
+                    shard.skim_rntuple = false;
+                    shard.skim_scales.clear();
+                }
+                frames.push_back(Hub::sample(shard));
+                progress::expect(frames.back());
+                node = encode_columns(apply_selection(frames.back().rnode(), *j.entry, opt), opt);
+            } else {
+                progress::expect(*j.frame);
             }
+            char name[32];
+            std::snprintf(name, sizeof(name), "shard_%03zu.root", i);
+            const auto path = (treeDir / name).string();
+            auto sopt = snapshot_options(opt, "RECREATE");
+            sopt.fLazy = true;
+            handles.emplace_back(node.Snapshot(j.tree, path, j.columns, sopt));
+            files.push_back((std::filesystem::path(j.tree) / name).string());
         }
+        trees[j.tree] = {{"files", files}, {"provenance", prov}};
+    }
+    if (!handles.empty())
+        ROOT::RDF::RunGraphs(handles);
 
-        if (!samples.empty())
-            outputs.push_back(outFile);
+    write_manifest(manifestPath, manifest);
+    return {manifestPath};
+}
+
+inline std::vector<std::string> write(const std::vector<const Entry*>& samples,
+                                      const Options& opt = {}) {
+    profile::Scope scope("snapshot:" + opt.tree);
+    memory::Stage stage("snapshot:" + opt.tree);
+    std::vector<std::string> outputs;
+    const auto jobs = plan(samples, opt);
+    if (jobs.empty())
         return outputs;
+    if (opt.shards > 1)
+        return write_sharded(jobs, opt);
+
+    if (opt.format == Format::RNTuple) {
+        for (const auto& j : jobs)
+            outputs.push_back(make_ntuple_path(opt, j.tree));
+    } else {
+        outputs.push_back(make_out_file(opt));
     }
+
+    const auto todo = opt.incremental ? stale_jobs(jobs, opt) : jobs;
+    if (todo.empty())
+        return outputs;
+    for (const auto& j : todo)
+        progress::expect(*j.frame);
+
+    if (opt.format == Format::RNTuple) {
+        write_ntuples(todo, opt);
+        return outputs;
+    }
+
+    const std::string& outFile = outputs.front();
+    const bool fileExists = std::filesystem::exists(outFile);
+    if (opt.parallel)
+        write_parallel(todo, opt, outFile, fileExists);
+    else
+        write_sequential(todo, opt, outFile, fileExists);
+    write_provenance(outFile, todo, opt);
+
+    return outputs;
+}
+
 }
 }
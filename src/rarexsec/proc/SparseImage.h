@@ -0,0 +1,48 @@
+#pragma once
+#include <ROOT/RVec.hxx>
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+
+namespace rarexsec {
+namespace sparse {
+
+template <class T>
+struct Image {
+    ROOT::RVec<unsigned int> index;
+    ROOT::RVec<T> value;
+    unsigned int size = 0;
+};
+
+inline std::string index_column(const std::string& col) { return col + "_idx"; }
+inline std::string value_column(const std::string& col) { return col + "_val"; }
+inline std::string size_column(const std::string& col) { return col + "_size"; }
+
+template <class T, class Dense>
+inline Image<T> encode(const Dense& dense, T threshold) {
+    Image<T> out;
+    out.size = static_cast<unsigned int>(dense.size());
+    for (std::size_t i = 0; i < dense.size(); ++i) {
+        if (dense[i] > threshold) {
+            out.index.push_back(static_cast<unsigned int>(i));
+            out.value.push_back(dense[i]);
+        }
+    }
+    return out;
+}
+
+template <class T, class Dense = ROOT::RVec<T>>
+inline Dense decode(const ROOT::RVec<unsigned int>& index, const ROOT::RVec<T>& value, unsigned int size,
+                    T fill = T{}) {
+    Dense out(size, fill);
+    const std::size_t n = std::min(index.size(), value.size());
+    for (std::size_t i = 0; i < n; ++i) {
+        if (index[i] < size)
+            out[index[i]] = value[i];
+    }
+    return out;
+}
+
+}
+}
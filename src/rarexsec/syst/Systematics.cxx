@@ -1,10 +1,18 @@
 #include "rarexsec/syst/Systematics.h"
+#include "rarexsec/proc/ColumnTrace.h"
+#include "rarexsec/proc/Expression.h"
+#include "rarexsec/proc/Memory.h"
+#include "rarexsec/proc/Profile.h"
+#include "rarexsec/proc/Progress.h"
+#include "rarexsec/proc/ResultStore.h"
+#include "rarexsec/proc/Snapshot.h"
 
 #include <algorithm>
 #include <cmath>
 #include <limits>
 #include <map>
 #include <memory>
+#include <nlohmann/json.hpp>
 #include <stdexcept>
 #include <string>
 #include <utility>
@@ -21,10 +29,12 @@ static std::string expr_column_name(const rarexsec::plot::TH1DModel& spec) {
 }
 
 ROOT::RDF::RNode with_expr(ROOT::RDF::RNode node, const rarexsec::plot::TH1DModel& spec) {
-    if (spec.expr.empty())
+    rarexsec::trace::use(spec.weight);
+    if (spec.expr.empty()) {
+        rarexsec::trace::use(!spec.id.empty() ? spec.id : spec.name);
         return node;
-    const std::string col = expr_column_name(spec);
-    return node.Define(col, spec.expr);
+    }
+    return rarexsec::expr::define(node, expr_column_name(spec), spec.expr);
 }
 
 static std::string expr_var(const rarexsec::plot::TH1DModel& spec) {
@@ -38,11 +48,68 @@ static std::string expr_var(const rarexsec::plot::TH1DModel& spec) {
     return expr_column_name(spec);
 }
 
-static std::unique_ptr<TH1D> sum_hists(std::vector<ROOT::RDF::RResultPtr<TH1D>> parts,
-                                       const std::string& name) {
+template <class T>
+static ROOT::RDF::RNode define_vector_universe(ROOT::RDF::RNode node, const std::string& col,
+                                              const std::string& branch, const std::string& weight,
+                                              const std::string& cv_branch, int k, double scale) {
+    if (cv_branch.empty()) {
+        return node.Define(
+            col,
+            [k, scale](const ROOT::RVec<T>& v, double w_nom) {
+                double wk = 1.0;
+                if (k >= 0 && k < (int)v.size())
+                    wk = static_cast<double>(v[k]) * scale;
+                const double out = w_nom * wk;
+                return std::isfinite(out) && out > 0.0 ? out : 0.0;
+            },
+            {branch, weight});
+    }
+    return node.Define(
+        col,
+        [k, scale](const ROOT::RVec<T>& v, double w_nom, double w_cv) {
+            double wk = 1.0;
+            if (k >= 0 && k < (int)v.size())
+                wk = static_cast<double>(v[k]) * scale;
+            const double out = w_nom * w_cv * wk;
+            return std::isfinite(out) && out > 0.0 ? out : 0.0;
+        },
+        {branch, weight, cv_branch});
+}
+
+static std::string store_key(const rarexsec::plot::TH1DModel& spec, const rarexsec::Entry& e,
+                             const rarexsec::Frame& f, const std::string& detvar,
+                             const nlohmann::json& universe = nullptr) {
+    nlohmann::json what{{"var", expr_var(spec)},
+                        {"expr", spec.expr},
+                        {"weight", spec.weight},
+                        {"sel", rarexsec::selection::preset_to_string(spec.sel)},
+                        {"bins", {spec.nbins, spec.xmin, spec.xmax}}};
+    if (!universe.is_null())
+        what["universe"] = universe;
+    return rarexsec::store::hist_key(e, f, detvar, std::move(what));
+}
+
+static rarexsec::store::Part book_stored(ROOT::RDF::RNode node, const rarexsec::plot::TH1DModel& spec,
+                                         const rarexsec::Entry& e, const rarexsec::Frame& f,
+                                         const std::string& detvar, const std::string& suffix) {
+    const auto model = spec.model(suffix);
+    auto part = rarexsec::store::lookup(store_key(spec, e, f, detvar), model);
+    if (part.hit && !rarexsec::trace::enabled())
+        return part;
+    auto n0 = rarexsec::selection::apply(node, spec.sel, e);
+    auto n1 = with_expr(n0, spec);
+    if (!part.hit) {
+        rarexsec::progress::expect(f);
+        part.booked = rarexsec::expr::histo1d(n1, model, expr_var(spec), spec.weight);
+    }
+    return part;
+}
+
+static std::unique_ptr<TH1D> sum_stored(std::vector<rarexsec::store::Part> parts, const std::string& name) {
+    rarexsec::profile::Scope scope("syst:" + name);
     std::unique_ptr<TH1D> total;
-    for (auto& rr : parts) {
-        const TH1D& h = rr.GetValue();
+    for (auto& p : parts) {
+        const TH1D& h = p.get();
         if (!total) {
             total.reset(static_cast<TH1D*>(h.Clone(name.c_str())));
             if (total)
@@ -58,18 +125,16 @@ std::unique_ptr<TH1D> rarexsec::syst::make_total_mc_hist(const rarexsec::plot::T
                                                          const std::vector<const Entry*>& entries,
                                                          const std::string& suffix) {
     TH1::SetDefaultSumw2(true);
-    std::vector<ROOT::RDF::RResultPtr<TH1D>> parts;
+    std::vector<rarexsec::store::Part> parts;
     parts.reserve(entries.size());
+    const auto lease = rarexsec::memory::book(spec.model(), entries.size(), "syst:" + spec.id);
     for (size_t ie = 0; ie < entries.size(); ++ie) {
         const Entry* e = entries[ie];
         if (!e)
             continue;
-        auto n0 = selection::apply(e->rnode(), spec.sel, *e);
-        auto n1 = with_expr(n0, spec);
-        auto var = expr_var(spec);
-        parts.push_back(n1.Histo1D(spec.model("_mc_src" + std::to_string(ie) + suffix), var, spec.weight));
+        parts.push_back(book_stored(e->rnode(), spec, *e, e->nominal, "", "_mc_src" + std::to_string(ie) + suffix));
     }
-    auto hist = sum_hists(std::move(parts), spec.id + suffix);
+    auto hist = sum_stored(std::move(parts), spec.id + suffix);
     if (!hist) {
         const std::string name = rarexsec::plot::Plotter::sanitise(spec.id + suffix);
         const std::string title = spec.title.empty() ? spec.id : spec.title;
@@ -85,7 +150,7 @@ std::unique_ptr<TH1D> rarexsec::syst::make_total_mc_hist_detvar(const rarexsec::
                                                                 const std::string& tag,
                                                                 const std::string& suffix) {
     TH1::SetDefaultSumw2(true);
-    std::vector<ROOT::RDF::RResultPtr<TH1D>> parts;
+    std::vector<rarexsec::store::Part> parts;
     parts.reserve(entries.size());
     for (size_t ie = 0; ie < entries.size(); ++ie) {
         const Entry* e = entries[ie];
@@ -94,13 +159,10 @@ std::unique_ptr<TH1D> rarexsec::syst::make_total_mc_hist_detvar(const rarexsec::
         const Frame* dv = e->detvar(tag);
         if (!dv)
             continue;
-        auto n0 = selection::apply(dv->rnode(), spec.sel, *e);
-        auto n1 = with_expr(n0, spec);
-        auto var = expr_var(spec);
-        parts.push_back(n1.Histo1D(spec.model("_mc_detvar_" + tag + "_src" + std::to_string(ie) + suffix),
-                                   var, spec.weight));
+        parts.push_back(book_stored(dv->rnode(), spec, *e, *dv, tag,
+                                    "_mc_detvar_" + tag + "_src" + std::to_string(ie) + suffix));
     }
-    auto hist = sum_hists(std::move(parts), spec.id + suffix);
+    auto hist = sum_stored(std::move(parts), spec.id + suffix);
     if (!hist) {
         const std::string name = rarexsec::plot::Plotter::sanitise(spec.id + suffix);
         const std::string title = spec.title.empty() ? spec.id : spec.title;
@@ -197,48 +259,35 @@ std::unique_ptr<TH1D> rarexsec::syst::make_total_mc_hist_weight_universe_ushort(
     const std::string& cv_branch, double us_scale) {
 
     TH1::SetDefaultSumw2(true);
-    std::vector<ROOT::RDF::RResultPtr<TH1D>> parts;
+    std::vector<rarexsec::store::Part> parts;
     parts.reserve(mc.size());
+    const auto lease = rarexsec::memory::book(spec.model(), mc.size(), "syst:" + spec.id);
 
     for (size_t ie = 0; ie < mc.size(); ++ie) {
         const Entry* e = mc[ie];
         if (!e)
             continue;
+        const auto model = spec.model("_mc_univ_us_" + std::to_string(k) + "_src" + std::to_string(ie) + suffix);
+        parts.push_back(rarexsec::store::lookup(
+            store_key(spec, *e, e->nominal, "", {{"vector", weights_branch}, {"k", k}, {"cv", cv_branch}, {"scale", us_scale}}),
+            model));
+        auto& part = parts.back();
+        if (part.hit && !rarexsec::trace::enabled())
+            continue;
 
         auto n0 = selection::apply(e->rnode(), spec.sel, *e);
         auto n1 = with_expr(n0, spec);
         auto var = expr_var(spec);
 
         const std::string col = "_w_us_univ_" + std::to_string(k) + "_src" + std::to_string(ie);
-        if (cv_branch.empty()) {
-            auto n2 = n1.Define(
-                col,
-                [k, us_scale](const ROOT::RVec<unsigned short>& v, double w_nom) {
-                    double wk = 1.0;
-                    if (k >= 0 && k < (int)v.size())
-                        wk = static_cast<double>(v[k]) * us_scale;
-                    const double out = w_nom * wk;
-                    return std::isfinite(out) && out > 0.0 ? out : 0.0;
-                },
-                {weights_branch, spec.weight});
-            parts.push_back(n2.Histo1D(spec.model("_mc_univ_us_" + std::to_string(k) + "_src" + std::to_string(ie) + suffix),
-                                       var, col));
-        } else {
-            auto n2 = n1.Define(
-                col,
-                [k, us_scale](const ROOT::RVec<unsigned short>& v, double w_nom, double w_cv) {
-                    double wk = 1.0;
-                    if (k >= 0 && k < (int)v.size())
-                        wk = static_cast<double>(v[k]) * us_scale;
-                    const double out = w_nom * w_cv * wk;
-                    return std::isfinite(out) && out > 0.0 ? out : 0.0;
-                },
-                {weights_branch, spec.weight, cv_branch});
-            parts.push_back(n2.Histo1D(spec.model("_mc_univ_us_" + std::to_string(k) + "_src" + std::to_string(ie) + suffix),
-                                       var, col));
+        rarexsec::trace::use({weights_branch, cv_branch});
+        auto n2 = define_vector_universe<unsigned short>(n1, col, weights_branch, spec.weight, cv_branch, k, us_scale);
+        if (!part.hit) {
+            rarexsec::progress::expect(e->nominal);
+            part.booked = rarexsec::expr::histo1d(n2, model, var, col);
         }
     }
-    return sum_hists(std::move(parts), spec.id + suffix);
+    return sum_stored(std::move(parts), spec.id + suffix);
 }
 
 TMatrixDSym rarexsec::syst::cov_from_weight_vector_ushort(
@@ -248,7 +297,10 @@ TMatrixDSym rarexsec::syst::cov_from_weight_vector_ushort(
 
     if (nuniv <= 0)
         return TMatrixDSym(0);
+    rarexsec::memory::Stage stage("syst:" + spec.id + ":" + weights_branch);
     auto H0 = rarexsec::syst::make_total_mc_hist(spec, mc, "_nom");
+    rarexsec::memory::Lease held(rarexsec::memory::clones, nuniv * rarexsec::memory::bytes(spec.model()),
+                                 "syst:" + spec.id + " universes");
     std::vector<std::unique_ptr<TH1D>> universes;
     universes.reserve(nuniv);
     for (int k = 0; k < nuniv; ++k) {
@@ -266,19 +318,43 @@ std::unique_ptr<TH1D> rarexsec::syst::make_total_mc_hist_weight_universe_map(
     const std::string& suffix, const std::string& cv_branch) {
 
     TH1::SetDefaultSumw2(true);
-    std::vector<ROOT::RDF::RResultPtr<TH1D>> parts;
+    std::vector<rarexsec::store::Part> parts;
     parts.reserve(mc.size());
+    const auto lease = rarexsec::memory::book(spec.model(), mc.size(), "syst:" + spec.id);
 
     for (size_t ie = 0; ie < mc.size(); ++ie) {
         const Entry* e = mc[ie];
         if (!e)
             continue;
+        const auto model = spec.model("_mc_univ_map_" + std::to_string(k) + "_src" + std::to_string(ie) + suffix);
+        parts.push_back(rarexsec::store::lookup(
+            store_key(spec, *e, e->nominal, "", {{"map", map_branch}, {"key", key}, {"k", k}, {"cv", cv_branch}}),
+            model));
+        auto& part = parts.back();
+        if (part.hit && !rarexsec::trace::enabled())
+            continue;
+        if (!part.hit)
+            rarexsec::progress::expect(e->nominal);
 
         auto n0 = selection::apply(e->rnode(), spec.sel, *e);
         auto n1 = with_expr(n0, spec);
         auto var = expr_var(spec);
 
         const std::string col = "_w_map_univ_" + std::to_string(k) + "_src" + std::to_string(ie);
+        const std::string flat = rarexsec::snapshot::map_column(map_branch, key, rarexsec::snapshot::MapEncoding::Float);
+        const std::string packed = rarexsec::snapshot::map_column(map_branch, key, rarexsec::snapshot::MapEncoding::UShort);
+        if (n1.HasColumn(flat) || n1.HasColumn(packed)) {
+            const bool use_flat = n1.HasColumn(flat);
+            const std::string& branch = use_flat ? flat : packed;
+            rarexsec::trace::use({branch, cv_branch});
+            auto n2 = use_flat ? define_vector_universe<float>(n1, col, branch, spec.weight, cv_branch, k, 1.0)
+                               : define_vector_universe<unsigned short>(n1, col, branch, spec.weight, cv_branch, k,
+                                                                        e->nominal.scale(branch, 1.0 / 1000.0));
+            if (!part.hit)
+                part.booked = rarexsec::expr::histo1d(n2, model, var, col);
+            continue;
+        }
+        rarexsec::trace::use({map_branch, cv_branch});
         if (cv_branch.empty()) {
             auto n2 = n1.Define(
                 col,
@@ -291,8 +367,8 @@ std::unique_ptr<TH1D> rarexsec::syst::make_total_mc_hist_weight_universe_map(
                     return std::isfinite(out) && out > 0.0 ? out : 0.0;
                 },
                 {map_branch, spec.weight});
-            parts.push_back(n2.Histo1D(spec.model("_mc_univ_map_" + std::to_string(k) + "_src" + std::to_string(ie) + suffix),
-                                       var, col));
+            if (!part.hit)
+                part.booked = rarexsec::expr::histo1d(n2, model, var, col);
         } else {
             auto n2 = n1.Define(
                 col,
@@ -305,11 +381,11 @@ std::unique_ptr<TH1D> rarexsec::syst::make_total_mc_hist_weight_universe_map(
                     return std::isfinite(out) && out > 0.0 ? out : 0.0;
                 },
                 {map_branch, spec.weight, cv_branch});
-            parts.push_back(n2.Histo1D(spec.model("_mc_univ_map_" + std::to_string(k) + "_src" + std::to_string(ie) + suffix),
-                                       var, col));
+            if (!part.hit)
+                part.booked = rarexsec::expr::histo1d(n2, model, var, col);
         }
     }
-    return sum_hists(std::move(parts), spec.id + suffix);
+    return sum_stored(std::move(parts), spec.id + suffix);
 }
 
 TMatrixDSym rarexsec::syst::cov_from_map_weight_vector(
@@ -319,7 +395,10 @@ TMatrixDSym rarexsec::syst::cov_from_map_weight_vector(
 
     if (nuniv <= 0)
         return TMatrixDSym(0);
+    rarexsec::memory::Stage stage("syst:" + spec.id + ":" + map_branch + ":" + key);
     auto H0 = rarexsec::syst::make_total_mc_hist(spec, mc, "_nom");
+    rarexsec::memory::Lease held(rarexsec::memory::clones, nuniv * rarexsec::memory::bytes(spec.model()),
+                                 "syst:" + spec.id + " universes");
     std::vector<std::unique_ptr<TH1D>> universes;
     universes.reserve(nuniv);
     for (int k = 0; k < nuniv; ++k) {
@@ -467,43 +546,31 @@ TMatrixDSym rarexsec::syst::block_cov_from_ud_ushort(
 
     auto apply_ud = [&](const TH1DModel& spec, const std::vector<const Entry*>& mc,
                         const std::string& branch, const char* tag) {
-        std::vector<ROOT::RDF::RResultPtr<TH1D>> parts;
+        std::vector<rarexsec::store::Part> parts;
         for (size_t ie = 0; ie < mc.size(); ++ie) {
             const Entry* e = mc[ie];
             if (!e)
                 continue;
+            const auto model = spec.model(std::string("_mc_ud_") + tag + "_src" + std::to_string(ie));
+            parts.push_back(rarexsec::store::lookup(
+                store_key(spec, *e, e->nominal, "",
+                          {{"vector", branch}, {"k", knob_index}, {"cv", cv_branch}, {"scale", us_scale}}),
+                model));
+            auto& part = parts.back();
+            if (part.hit && !rarexsec::trace::enabled())
+                continue;
             auto n0 = selection::apply(e->rnode(), spec.sel, *e);
             auto n1 = with_expr(n0, spec);
             auto var = expr_var(spec);
             const std::string col = std::string("_w_ud_") + tag + "_" + std::to_string(knob_index) + "_src" + std::to_string(ie);
-
-            if (cv_branch.empty()) {
-                auto n2 = n1.Define(
-                    col,
-                    [knob_index, us_scale](const ROOT::RVec<unsigned short>& v, double w_nom) {
-                        double wk = 1.0;
-                        if (knob_index >= 0 && knob_index < (int)v.size())
-                            wk = static_cast<double>(v[knob_index]) * us_scale;
-                        const double out = w_nom * wk;
-                        return std::isfinite(out) && out > 0.0 ? out : 0.0;
-                    },
-                    {branch, spec.weight});
-                parts.push_back(n2.Histo1D(spec.model(std::string("_mc_ud_") + tag + "_src" + std::to_string(ie)), var, col));
-            } else {
-                auto n2 = n1.Define(
-                    col,
-                    [knob_index, us_scale](const ROOT::RVec<unsigned short>& v, double w_nom, double w_cv) {
-                        double wk = 1.0;
-                        if (knob_index >= 0 && knob_index < (int)v.size())
-                            wk = static_cast<double>(v[knob_index]) * us_scale;
-                        const double out = w_nom * w_cv * wk;
-                        return std::isfinite(out) && out > 0.0 ? out : 0.0;
-                    },
-                    {branch, spec.weight, cv_branch});
-                parts.push_back(n2.Histo1D(spec.model(std::string("_mc_ud_") + tag + "_src" + std::to_string(ie)), var, col));
+            rarexsec::trace::use({branch, cv_branch});
+            auto n2 = define_vector_universe<unsigned short>(n1, col, branch, spec.weight, cv_branch, knob_index, us_scale);
+            if (!part.hit) {
+                rarexsec::progress::expect(e->nominal);
+                part.booked = rarexsec::expr::histo1d(n2, model, var, col);
             }
         }
-        return sum_hists(std::move(parts), spec.id + "_" + tag);
+        return sum_stored(std::move(parts), spec.id + "_" + tag);
     };
 
     auto HupA = apply_ud(specA, A, up_branch, "upA");
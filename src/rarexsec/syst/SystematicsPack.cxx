@@ -3,9 +3,16 @@
 #include <ROOT/RDataFrame.hxx>
 #include <ROOT/RVec.hxx>
 #include <cmath>
+#include <nlohmann/json.hpp>
 #include <stdexcept>
 
+#include "rarexsec/proc/ColumnTrace.h"
 #include "rarexsec/proc/DataModel.h"
+#include "rarexsec/proc/Expression.h"
+#include "rarexsec/proc/Memory.h"
+#include "rarexsec/proc/Profile.h"
+#include "rarexsec/proc/Progress.h"
+#include "rarexsec/proc/ResultStore.h"
 #include "rarexsec/syst/Systematics.h"
 
 namespace rarexsec::systpack {
@@ -18,12 +25,20 @@ std::unique_ptr<TH1D> clone_reset_like(const TH1D& templ, const std::string& nam
   return h;
 }
 //_______________________________________________________________________________________
-std::unique_ptr<TH1D> sum_parts(std::vector<ROOT::RDF::RResultPtr<TH1D>>& parts,
+std::string store_key(const TH1D& model, const rarexsec::Entry& e, nlohmann::json what) {
+  std::vector<double> edges;
+  for (int i = 1; i <= model.GetNbinsX() + 1; ++i) edges.push_back(model.GetXaxis()->GetBinLowEdge(i));
+  what["edges"] = edges;
+  return rarexsec::store::hist_key(e, e.nominal, "", std::move(what));
+}
+//_______________________________________________________________________________________
+std::unique_ptr<TH1D> sum_parts(std::vector<rarexsec::store::Part>& parts,
                                 const TH1D& model, const std::string& name) 
 {
+  rarexsec::profile::Scope scope("systpack:" + name);
   std::unique_ptr<TH1D> total;
-  for (auto& rr : parts) {
-    const TH1D& h = rr.GetValue();
+  for (auto& part : parts) {
+    const TH1D& h = part.get();
     if (!total) {
       total.reset(static_cast<TH1D*>(h.Clone(name.c_str())));
       total->SetDirectory(nullptr);
@@ -41,12 +56,18 @@ std::unique_ptr<TH1D> make_total_hist(const TH1D& model,
                                       const std::vector<const rarexsec::Entry*>& entries,
                                       const std::string& name_suffix) 
 {
-  std::vector<ROOT::RDF::RResultPtr<TH1D>> parts;
+  rarexsec::trace::use({value_col, weight_col});
+  std::vector<rarexsec::store::Part> parts;
   parts.reserve(entries.size());
+  const auto lease = rarexsec::memory::book(model, entries.size(), model.GetName());
   for (auto* e : entries) {
     if (!e) continue;
+    parts.push_back(rarexsec::store::lookup(store_key(model, *e, {{"value", value_col}, {"weight", weight_col}}),
+                                            ROOT::RDF::TH1DModel(model)));
+    if (parts.back().hit) continue;
+    rarexsec::progress::expect(e->nominal);
     auto node = e->rnode();
-    parts.emplace_back(node.Histo1D(model, value_col, weight_col));
+    parts.back().booked = rarexsec::expr::histo1d(node, model, value_col, weight_col);
   }
   return sum_parts(parts, model, std::string(model.GetName()) + name_suffix);
 }
@@ -61,11 +82,19 @@ std::unique_ptr<TH1D> make_total_hist_universe_ushort(const TH1D& model,
                                                       const std::string& cv_branch,
                                                       const std::string& name_suffix) 
 {
-  std::vector<ROOT::RDF::RResultPtr<TH1D>> parts;
+  rarexsec::trace::use({value_col, base_weight_col, weights_branch, cv_branch});
+  std::vector<rarexsec::store::Part> parts;
   parts.reserve(entries.size());
+  const auto lease = rarexsec::memory::book(model, entries.size(), model.GetName());
   for (size_t ie = 0; ie < entries.size(); ++ie) {
     auto* e = entries[ie];
     if (!e) continue;
+    parts.push_back(rarexsec::store::lookup(
+      store_key(model, *e, {{"value", value_col}, {"weight", base_weight_col}, {"vector", weights_branch},
+                            {"k", k}, {"cv", cv_branch}, {"scale", us_scale}}),
+      ROOT::RDF::TH1DModel(model)));
+    if (parts.back().hit) continue;
+    rarexsec::progress::expect(e->nominal);
     auto node = e->rnode();
     const std::string col = "_rx_univ_" + std::to_string(k) + "_src" + std::to_string(ie);
     if (cv_branch.empty()) {
@@ -76,7 +105,7 @@ std::unique_ptr<TH1D> make_total_hist_universe_ushort(const TH1D& model,
           const double out = w_nom * wk;
           return (std::isfinite(out) && out > 0.0) ? out : 0.0;
         }, {weights_branch, base_weight_col});
-      parts.emplace_back(n1.Histo1D(model, value_col, col));
+      parts.back().booked = rarexsec::expr::histo1d(n1, model, value_col, col);
     } else {
       auto n1 = node.Define(col,
         [k, us_scale](const ROOT::RVec<unsigned short>& v, double w_nom, double w_cv) {
@@ -85,7 +114,7 @@ std::unique_ptr<TH1D> make_total_hist_universe_ushort(const TH1D& model,
           const double out = w_nom * w_cv * wk;
           return (std::isfinite(out) && out > 0.0) ? out : 0.0;
         }, {weights_branch, base_weight_col, cv_branch});
-      parts.emplace_back(n1.Histo1D(model, value_col, col));
+      parts.back().booked = rarexsec::expr::histo1d(n1, model, value_col, col);
     }
   }
   return sum_parts(parts, model, std::string(model.GetName()) + name_suffix);
@@ -103,6 +132,10 @@ Result SystematicsPack::build(const TH1D& model,
   using rarexsec::syst::sum;
 
   Result out;
+  rarexsec::memory::Stage stage(std::string("systpack:") + model.GetName());
+  const int n_cov = 3 + cfg_.use_ppfx + cfg_.use_genie + cfg_.use_reint + cfg_.include_ext;
+  rarexsec::memory::Lease covs(rarexsec::memory::covariances,
+                               n_cov * rarexsec::memory::matrix_bytes(model.GetNbinsX()), "systpack:covariances");
 
   auto H_mc = make_total_hist(model, cfg_.value_col, cfg_.weight_col, mc_entries, "_mc");
   if (!H_mc) throw std::runtime_error("SystematicsPack: MC nominal is empty");
@@ -110,6 +143,8 @@ Result SystematicsPack::build(const TH1D& model,
   out.sources["MC stat"] = mc_stat_covariance(*H_mc);
 
   if (cfg_.use_ppfx && cfg_.N_ppfx > 0) {
+    rarexsec::memory::Stage family("ppfx");
+    rarexsec::memory::Lease held(rarexsec::memory::clones, cfg_.N_ppfx * rarexsec::memory::bytes(model), "systpack:ppfx universes");
     std::vector<std::unique_ptr<TH1D>> universes;
     universes.reserve(cfg_.N_ppfx);
     for (int k = 0; k < cfg_.N_ppfx; ++k) {
@@ -123,6 +158,8 @@ Result SystematicsPack::build(const TH1D& model,
   }
 
   if (cfg_.use_genie && cfg_.N_genie > 0) {
+    rarexsec::memory::Stage family("genie");
+    rarexsec::memory::Lease held(rarexsec::memory::clones, cfg_.N_genie * rarexsec::memory::bytes(model), "systpack:genie universes");
     std::vector<std::unique_ptr<TH1D>> universes;
     universes.reserve(cfg_.N_genie);
     for (int k = 0; k < cfg_.N_genie; ++k) {
@@ -136,6 +173,8 @@ Result SystematicsPack::build(const TH1D& model,
   }
 
   if (cfg_.use_reint && cfg_.N_reint > 0) {
+    rarexsec::memory::Stage family("reint");
+    rarexsec::memory::Lease held(rarexsec::memory::clones, cfg_.N_reint * rarexsec::memory::bytes(model), "systpack:reint universes");
     std::vector<std::unique_ptr<TH1D>> universes;
     universes.reserve(cfg_.N_reint);
     for (int k = 0; k < cfg_.N_reint; ++k) {